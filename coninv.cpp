@@ -1,458 +1,4308 @@
-/**
- * Program: Console Invaders
- * 
- * A simple Space Invaders clone done on the MS Windows Console. The objective of this 
- * program is to be a demo of standard game development concepts following the example
- * of Javidx9's blog (http://www.onelonecoder.com/).
- * 
- * It showcases some interesting techniques:
- * - Fast prototyping on the console
- * - Focus on getting the fundamental game logic done, rather than fancy graphics
- * - Experiment with game loop timing and the practical uses of the `chrono` library
- * - Simple animations and a pinch of creativity with characters
- * - Use of UNICODE strings
- * - Using some Win32 API on the console for fast animations
- * 
- * \author Christian Bruccoleri
- * This is free software. Do with it whatever you want. LICENSE: GPLv3
- */
-
-#include <iostream>
-#include <string>
-#include <stdexcept>
-#include <thread>
-#include <chrono>
-#include <cstdio>
-#include <cmath>
-#include <cstdlib>
-#include <vector>
-#include <assert.h>
-using namespace std;
-
-#include <Windows.h>
-
-// Game screen parameters
-static const int nScreenWidth = 120;
-static const int nScreenHeight = 30;
-
-// Array of 10 x 4 aliens; valid states:
-static const int nAlienBlockWidth = 10;
-static const int nAlienBlockHeight = 4;
-// 0 - Alive, 1 - Exploding, 2 - Dead
-unsigned char alienState[nAlienBlockWidth*nAlienBlockHeight];
-// 1: left to right, -1: right to left 
-int nAlienStep = 1;
-// Number of aliens remaining
-int nAliens = nAlienBlockWidth*nAlienBlockHeight;
-
-// "graphical" representation of the aliens; each frame is 3 characters
-const int nAlienGlyphWidth = 3;
-wstring alienGlyphs[4] = {L"<o>>o<", L"}O{-O-", L"[T]]+[", L"(+)-x-"};
-//wstring shieldGlyphs = {L" \x2591\2592\2593\x2588"};
-wstring shieldGlyphs = {L" -=#"};
-wstring playerGlyph = L"<I>";
-
-// game state variables
-float fPlayerX;
-static const int nPlayerY = nScreenHeight - 1;
-float fPlayerVx;
-float fPlayerBulletSpeed;
-int nAlienBlockX;
-int nAlienBlockY;
-float fExplodingElapsed;
-int nAlienExploding; // -1: none exploding yet
-// How fast alien bullets move
-float fAlienBulletSpeed;
-
-// Arrow Left, Arrow Right, Spacebar, ESC, Pause
-static const int nPlayerKeys = 5;
-bool bKeyPressed[nPlayerKeys] = {false, false, false, false, false};
-// Used to latch the key presses
-bool bKeyHold[nPlayerKeys] = {true, true, true, true, true};
-enum KeyMnemonics {
-    LEFT_ARROW,
-    RIGHT_ARROW,
-    SPACEBAR,
-    ESC,
-    PAUSE
-};
-
-
-struct Shield {
-    static const int Length = 8;
-    static const int Height = 3;
-    static const int MaxStrength = 3;
-    int m_strength[Length*Height];
-    int nX;
-    int nY;
-
-
-    Shield(int x, int y) {
-        for (int i = 0; i < Length*Height; ++i) m_strength[i] = MaxStrength;
-        nX = x;
-        nY = y;
-    }
-
-
-    bool hit(int colX, int rowY) {
-        if (nX <= colX && colX < (nX + Length) && nY <= rowY && rowY < (nY + Height)) {
-            int shieldOff = (rowY-nY)*Length + (colX-nX);
-            assert(0 <= shieldOff && shieldOff < Length*Height);
-            if (m_strength[shieldOff] > 0) {
-                m_strength[shieldOff] --;
-                return true;
-            }
-            else return false;
-        }
-        else return false;
-    }
-};
-
-// Barriers to protect the player
-vector<Shield> shields;
-
-
-// Screen buffer
-wchar_t *screen = new wchar_t[nScreenWidth*nScreenHeight];
-
-struct Bullet {
-    bool visible;
-    float x;
-    float y;
-    wchar_t glyph;
-    Bullet(wchar_t _glyph=L'|'): visible(false), x(0), y(0), glyph(_glyph) {};
-};
-
-
-void InitGame()
-{
-    // game state variables
-    fPlayerX = (float)(nScreenWidth - playerGlyph.length()) / 2.0f;
-    fPlayerVx = 12.0f;
-    fPlayerBulletSpeed = -20.0f;
-    nAlienBlockX = 2;
-    nAlienBlockY = 2;
-    fExplodingElapsed = 0.0f;
-    nAlienExploding = -1; // -1: none exploding yet
-    // How fast alien bullets move
-    fAlienBulletSpeed = 20.0f;
-    shields.clear();
-    for (int i = 0; i < 3; ++i) shields.push_back(Shield((i+1)*30, nScreenHeight-6)); 
-}
-
-
-inline bool AlienFire(vector<Bullet>& alienBullets, int i, int j)
-{
-    for (auto& b: alienBullets)
-        if (! b.visible) {
-            b.x = (float)(nAlienBlockX + 6*j + 1);
-            b.y = (float)(nAlienBlockY + i + 1);
-            b.visible = true;
-            return true;
-        }
-    return false;
-}
-
-
-inline void ClearBuffer(wchar_t* pScreenBuf)
-{
-	for (int i = 0; i < nScreenWidth*nScreenHeight; i++) 
-        pScreenBuf[i] = L' ';
-}
-
-
-inline int GetAlienScreenOffset(int i, int j)
-{
-    return (2*i + nAlienBlockY)*nScreenWidth + nAlienBlockX + j*6;
-}
-
-
-void DrawAliens(int nFrameOffset)
-{
-    for (int i = 0; i < nAlienBlockHeight; ++i) {
-        for (int j = 0; j < nAlienBlockWidth; ++j) {
-            int nScreenOffset = GetAlienScreenOffset(i,j);
-            const int alienIndex = i*nAlienBlockWidth + j;
-            int state = alienState[alienIndex];
-            switch (state) {
-                case 0: // alive
-                    for (int k = 0; k < 3; ++k)
-                        screen[nScreenOffset + k] = alienGlyphs[i % 4][nFrameOffset + k];
-                    break;
-                case 1: // exploding
-                    for (int k = 0; k < 3; ++k)
-                        screen[nScreenOffset + k] = L'x';
-                    break;
-                case 2: // dead; draw blanks
-                    //screen[nScreenOffset + k] = L' ';
-                    break;
-                default:
-                    break;
-            }
-        }
-    }
-}
-
-
-bool HitAlien(const Bullet* bullet, int* iAlien, int* jAlien) {
-    int nBulletY = (int)roundf(bullet->y);
-    int nBulletX = (int)roundf(bullet->x);
-    int bulletIndex = (nBulletY-1)*nScreenWidth + nBulletX;
-    const wstring specialChars = L"*#=- "; // characters to ignore
-    bool bHitAlien = bullet->y > 0; // have not reached the top of the screen AND ..
-    for (int k = 0; k < specialChars.length(); ++k) { // not any of the special characters
-        bHitAlien &= (screen[bulletIndex] != specialChars[k]);
-        if (!bHitAlien) break;
-    }
-    if (bHitAlien) { // Got one; figure out which one
-        for (int i = 0; i < nAlienBlockHeight; ++i) {
-            for (int j = 0; j < nAlienBlockWidth; ++j) {
-                int alienOffset = GetAlienScreenOffset(i, j);
-                if (alienOffset <= bulletIndex && bulletIndex < (alienOffset+3)) {
-                    *iAlien = i;
-                    *jAlien = j;
-                    i = nAlienBlockHeight;
-                    break;
-                }
-            }
-        }
-    }
-    return bHitAlien;
-}
-
-
-void DrawPlayer(bool bPlayerHit)
-{
-    int nPlayerX = (int)roundf(fPlayerX);
-    for (int k = 0; k < playerGlyph.length(); ++k) {
-        const int offset = nPlayerY*nScreenWidth + nPlayerX + k;
-        if (offset < nScreenHeight*nScreenWidth) screen[offset] = bPlayerHit ? L'X': playerGlyph[k];
-    }
-}
-
-
-inline void DrawBullets(const vector<Bullet>& alienBullets, Bullet* pBullet)
-{
-    // player
-    int nBulletY = (int)roundf(pBullet->y);
-    int nBulletX = (int)roundf(pBullet->x);
-    if (pBullet->visible)
-        screen[nBulletY*nScreenWidth + nBulletX] = pBullet->glyph;
-    // aliens
-    for (auto &b: alienBullets)
-        if (b.visible) {
-            int nX = (int)roundf(b.x);
-            int nY = (int)roundf(b.y);
-            screen[nY*nScreenWidth + nX] = b.glyph;
-        }
-}
-
-
-void DrawShields()
-{
-    for (auto& shld: shields)
-        for (int i = 0; i < Shield::Height; ++i)
-            for (int j = 0; j < Shield::Length; ++j) {
-                const int nScreenOffset = (shld.nY + i)*nScreenWidth + shld.nX + j;
-                const int nStrengthVal =  shld.m_strength[i*Shield::Length + j];
-                screen[nScreenOffset] = shieldGlyphs[nStrengthVal];
-            }
-}
-
-
-
-int main()
-{
-    ClearBuffer(screen);
-	HANDLE hConsole = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE, 0, NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
-	SetConsoleActiveScreenBuffer(hConsole);
-	DWORD dwBytesWritten = 0;
-    bool bQuit = false;
-    while (! bQuit) {
-        InitGame();
-        bool bGameOver = false;
-        bool bPlayerHit = false;    // true IFF player has been hit
-        bool bUpdateAnim = false;   // true IFF a predetermined amount of time has elapsed since last frame
-        float fAnimElapsed = 0.0f;  // counter for animation time
-        int nFrameOffset = 0;
-        int nScore = 0; // Score
-        int nLives = 3;// Number of player lives
-        int iAlien = -1, jAlien = -1;
-        float fAnimDelay = 0.35f; // Delay between animations
-        Bullet bullet;
-        // Used to initialize the vector
-        const int nMaxAlienBullet = 5;
-        vector<Bullet> alienBullets;
-        // initialize all aliens to state "Alive
-        alienBullets.clear();
-        for (int k = 0; k < nAlienBlockHeight*nAlienBlockWidth; ++k) alienState[k] = 0;
-        for (int k = 0; k < nMaxAlienBullet; ++k) alienBullets.push_back(Bullet('*'));
-        // initialize timers
-        auto tp1 = chrono::system_clock::now();
-        auto tp2 = chrono::system_clock::now();
-        while (! bGameOver) {
-            // Update timing
-            tp2 = chrono::system_clock::now();
-            chrono::duration<float> elapsedTime = tp2 - tp1;
-            tp1 = tp2;
-            float fElapsedTime = elapsedTime.count();
-            fAnimElapsed += fElapsedTime;
-            bUpdateAnim = fAnimElapsed >= fAnimDelay;
-
-            // Get Player Input
-            for (int k = 0; k < nPlayerKeys; ++k)
-                bKeyPressed[k] = (GetAsyncKeyState((unsigned char)"\x25\x27\x20\x1b\x13"[k]) & 0x8000) != 0;
-
-            if (bKeyPressed[ESC]) // player requests exit
-                bGameOver = bQuit = true;
-
-            if (bKeyPressed[LEFT_ARROW] && ! bPlayerHit) {
-                float dx = fPlayerVx * fElapsedTime;
-                if (fPlayerX > dx) fPlayerX -= dx;
-                else fPlayerX = 0.0f;
-            }
-            else bKeyHold[LEFT_ARROW] = true;
-
-            if (bKeyPressed[RIGHT_ARROW] && ! bPlayerHit) {
-                float dx = fPlayerVx * fElapsedTime;
-                const float maxX = (float)(nScreenWidth - playerGlyph.length());
-                if (fPlayerX + dx <= maxX) fPlayerX += dx;
-                else fPlayerX = maxX;
-            }
-            else bKeyHold[RIGHT_ARROW] = true;
-
-            // Firing
-            if (bullet.visible) { // already fired; move bullet
-                bullet.y += fPlayerBulletSpeed * fElapsedTime;
-                int nBulletX = (int)roundf(bullet.x);
-                int nBulletY = (int)roundf(bullet.y);
-                // check if the shields are hit
-                for (auto& shld: shields)
-                    if (shld.hit(nBulletX, nBulletY)) 
-                        bullet.visible = false;
-                if (nBulletY <= 0)
-                    bullet.visible = false;
-                else if (HitAlien(&bullet, &iAlien, &jAlien)) {
-                    bullet.visible = false;
-                    alienState[iAlien*nAlienBlockWidth + jAlien] = 1; // exploding
-                    fExplodingElapsed = 0.0f;
-                    nAlienExploding = iAlien*nAlienBlockWidth + jAlien;
-                    nScore += 100;
-                }
-            }
-            else if (bKeyPressed[SPACEBAR] && bKeyHold[SPACEBAR]  && ! bPlayerHit) { // firing new bullet?
-                bullet.y = (float)nScreenHeight - 2.0f;
-                bullet.x = fPlayerX + 1.0f;
-                bullet.visible = true;
-                bKeyHold[SPACEBAR] = false;
-            }
-            else { // spacebar released
-                bKeyHold[SPACEBAR] = true;
-            }
-
-            //// Update Logic
-            // Move the aliens
-            if (nAlienBlockY + nAlienBlockHeight >= nScreenHeight) {
-                // Aliens at the bottom of the screen
-                bGameOver = true;
-                nAlienBlockY = 2;
-            }
-            else if (bUpdateAnim && (nAlienBlockX + 2*nAlienBlockWidth*nAlienGlyphWidth >= nScreenWidth)) {
-                // reached the right side of the screen
-                nAlienStep = (nAlienStep == 1) ? -1: 1;
-                nAlienBlockY ++;
-                nAlienBlockX --;
-                fAnimDelay -= (fAnimDelay > 10.0) ? 0.05f: 0.0f;
-            }
-            else if (bUpdateAnim && (nAlienBlockX <= 0)) {
-                // reached the left side of the screen
-                nAlienStep = (nAlienStep == 1) ? -1: 1;
-                nAlienBlockY ++;
-                nAlienBlockX ++;
-                fAnimDelay -= (fAnimDelay > 10.0) ? 0.05f: 0.0f;
-            }
-            else {
-                // move aliens by one lateral step, if it is time to do it
-                nAlienBlockX += bUpdateAnim ? nAlienStep: 0;
-            }
-            // update alien firing
-            for (int i = 0; i < nAlienBlockHeight; ++i)
-                for (int j = 0; j < nAlienBlockWidth; ++j) {
-                    if (alienState[i*nAlienBlockWidth + j] == 0) { // alien is alive
-                        float fRandfireVal = (float)rand() / (float)RAND_MAX;
-                        float fProbFire;
-                        // prefer firing if aligned with the player; otherwise at random
-                        if ( (nAlienBlockX + 6*j) == (int)roundf(fPlayerX) ) fProbFire = 0.20f;
-                        else fProbFire = 0.02f;
-                        if (fRandfireVal < fProbFire) AlienFire(alienBullets, i, j);
-                    }
-                }
-            // update alien bullets
-            for (auto& b: alienBullets)
-                if (b.visible) {
-                    b.y += fAlienBulletSpeed*fElapsedTime;
-                    int nY = (int)roundf(b.y);
-                    int nX = (int)roundf(b.x);
-                    int nPlayerX = (int)roundf(fPlayerX);
-                    // check if a shield has been hit
-                    for (auto& shld: shields)
-                        if (shld.hit(nX, nY)) b.visible = false;
-                    if ( ! bPlayerHit && nY == nScreenHeight && nPlayerX <= nX && nX < (nPlayerX+3) ) {
-                        // player has been hit
-                        bPlayerHit = true;
-                        nLives -= (nLives > 0) ? 1: 0;
-                        bGameOver = nLives == 0;
-                        b.visible = false;
-
-                    }
-                    else if ( nY >= nScreenHeight ) b.visible = false;
-                }
-            // animate exploding alien
-            if (nAlienExploding != -1) {
-                // one alien is blowing up
-                if (fExplodingElapsed < 0.6f) {
-                    fExplodingElapsed += fElapsedTime;
-                }
-                else {
-                    alienState[nAlienExploding] = 2; // dead
-                    nAlienExploding = -1;
-                    fExplodingElapsed = 0.0f;
-                }
-            }
-            // animate exploding player
-            if (bPlayerHit)
-                if (fExplodingElapsed < 1.0f)
-                    fExplodingElapsed += fElapsedTime;
-                else {
-                    fExplodingElapsed = 0.0f;
-                    bPlayerHit = false;
-                }
-
-            // Update screen
-            ClearBuffer(screen);
-            int nc = swprintf_s(&screen[2], 64, 
-                L"Score: %6d   Lives: %2d   FPS: %.1f", nScore, nLives, 1.0f/fElapsedTime);
-            screen[2+nc] = ' ';
-            DrawShields();
-            DrawAliens(nFrameOffset);
-            DrawPlayer(bPlayerHit);
-            DrawBullets(alienBullets, &bullet);
-            WriteConsoleOutputCharacter(hConsole, screen, nScreenWidth * nScreenHeight, { 0,0 }, &dwBytesWritten);
-            if (bUpdateAnim) {
-                nFrameOffset = nFrameOffset == 3 ? 0 : 3;
-                fAnimElapsed = 0.0f;
-            }
-        }
-        swprintf_s(&screen[nScreenWidth*nScreenHeight/2 + nScreenWidth/2 - 20], 40, L"GAME OVER! Press Spacebar to restart.");
-        WriteConsoleOutputCharacter(hConsole, screen, nScreenWidth * nScreenHeight, { 0,0 }, &dwBytesWritten);
-        // Spacebar: continue, ESC: exit
-        while ( ! bQuit && (GetAsyncKeyState((unsigned char)'\x20') & 0x8000) == 0 ) {
-            bQuit = (GetAsyncKeyState( (unsigned char)'\x1b') & 0x8000) != 0;
-            this_thread::sleep_for(5ms);
-        }
-    }
-
-	CloseHandle(hConsole);
-	cout << "Game Over!!" << endl;
-    return 0;
-}
+/**
+ * Program: Console Invaders
+ * 
+ * A simple Space Invaders clone done on the MS Windows Console, also playable on any VT
+ * terminal (Linux, macOS). The objective of this 
+ * program is to be a demo of standard game development concepts following the example
+ * of Javidx9's blog (http://www.onelonecoder.com/).
+ * 
+ * It showcases some interesting techniques:
+ * - Fast prototyping on the console
+ * - Focus on getting the fundamental game logic done, rather than fancy graphics
+ * - Experiment with game loop timing and the practical uses of the `chrono` library
+ * - Simple animations and a pinch of creativity with characters
+ * - Use of UNICODE strings
+ * - Using some Win32 API on the console for fast animations
+ * - Escape sequences to do the same on other terminals
+ * 
+ * \author Christian Bruccoleri
+ * This is free software. Do with it whatever you want. LICENSE: GPLv3
+ */
+
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+#include <fstream>
+#include <iomanip>
+#include <cstring>
+#include <cwchar>
+#include <cstdint>
+#include <climits>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <assert.h>
+using namespace std;
+
+#if defined(_WIN32)
+// Windows Sockets 2, which must come before Windows.h
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <Windows.h>
+#if defined(_MSC_VER)
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+#else
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+// The cells of the screen buffer are laid out as those of the Win32 console on every platform
+typedef uint16_t WORD;
+struct CHAR_INFO {
+    union {
+        wchar_t UnicodeChar;
+        char AsciiChar;
+    } Char;
+    WORD Attributes;
+};
+#define FOREGROUND_BLUE      0x0001
+#define FOREGROUND_GREEN     0x0002
+#define FOREGROUND_RED       0x0004
+#define FOREGROUND_INTENSITY 0x0008
+#define BACKGROUND_BLUE      0x0010
+#define BACKGROUND_GREEN     0x0020
+#define BACKGROUND_RED       0x0040
+#define BACKGROUND_INTENSITY 0x0080
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Game screen parameters, set once at startup by ConfigureBoard()
+int nScreenWidth = 120;
+int nScreenHeight = 30;
+
+// Array of aliens, 10 x 4 by default
+int nAlienBlockWidth = 10;
+int nAlienBlockHeight = 4;
+// How many alien bullets can be in flight at the same time
+int nMaxAlienBullets = 5;
+
+
+// Message of the fatal error the program is aborting on, to show again once the terminal is restored
+char szFatalError[160];
+
+
+/**
+ * Once running, the frame loop must not touch the heap: an allocation can take a lock, or a
+ * trip to the kernel, at any time. The threads of the loop say so with a NoAllocationScope;
+ * in builds with assertions, the global operator new aborts on any allocation made in one.
+ */
+thread_local const char* szNoAllocationScope = NULL;   // what the thread is doing, if it must not allocate
+
+
+// Forbids the calling thread to allocate from the heap for as long as it lives
+struct NoAllocationScope {
+    const char* m_szOuter;
+
+
+    NoAllocationScope(const char* szName): m_szOuter(szNoAllocationScope) { szNoAllocationScope = szName; }
+
+
+    ~NoAllocationScope() { szNoAllocationScope = m_szOuter; }
+};
+
+
+#if ! defined(NDEBUG)
+void* operator new(size_t nBytes)
+{
+    if (szNoAllocationScope != NULL) {
+        snprintf(szFatalError, sizeof(szFatalError), "heap allocation of %u bytes in %s\n", (unsigned)nBytes, szNoAllocationScope);
+        fputs(szFatalError, stderr);
+        abort();
+    }
+    if (void* p = malloc(nBytes > 0 ? nBytes: 1)) return p;
+    throw bad_alloc();
+}
+
+
+// out of line: the compiler would otherwise see free() take what operator new returned, and warn
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { operator delete(p); }
+#endif
+
+
+/**
+ * Scratch memory for the work of a frame, carved out of a block allocated up front:
+ * allocate() bumps a pointer, and reset() hands everything back at once when the frame is
+ * done. The block is sized for the worst frame, so running out of it is a bug, and aborts.
+ */
+struct FrameArena {
+    unique_ptr<unsigned char[]> m_pBlock;
+    size_t m_nSize;
+    size_t m_nUsed;
+
+
+    FrameArena(): m_nSize(0), m_nUsed(0) {}
+
+
+    // Allocate a block of nBytes; whatever was taken from the one before is given back
+    void reserve(size_t nBytes) {
+        m_pBlock.reset(new unsigned char[nBytes]);
+        m_nSize = nBytes;
+        m_nUsed = 0;
+    }
+
+
+    // Room for nCount objects of type T, left uninitialized
+    template <typename T>
+    T* allocate(size_t nCount) {
+        const size_t nStart = (m_nUsed + alignof(T) - 1) & ~(alignof(T) - 1);
+        if (nStart + nCount*sizeof(T) > m_nSize) {
+            snprintf(szFatalError, sizeof(szFatalError), "frame arena of %u bytes exhausted\n", (unsigned)m_nSize);
+            fputs(szFatalError, stderr);
+            abort();
+        }
+        m_nUsed = nStart + nCount*sizeof(T);
+        return (T*)(m_pBlock.get() + nStart);
+    }
+
+
+    void reset() { m_nUsed = 0; }
+};
+
+
+// Index of the lowest set bit of a non-zero word
+inline int LowestBit(uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long nIndex;
+    _BitScanForward64(&nIndex, word);
+    return (int)nIndex;
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+
+// Index of the highest set bit of a non-zero word
+inline int HighestBit(uint64_t word)
+{
+#if defined(_MSC_VER)
+    unsigned long nIndex;
+    _BitScanReverse64(&nIndex, word);
+    return (int)nIndex;
+#else
+    return 63 - __builtin_clzll(word);
+#endif
+}
+
+
+/**
+ * State of the aliens of the formation, packed one bit per alien in two bitsets: alive and
+ * exploding (an alien in neither is dead). Each row of the grid starts on a new 64-bit word,
+ * so that alien (i, j) is bit `j % 64` of word `i*nWordsPerRow + j / 64`.
+ * 
+ * Counts of the living aliens per row and per column, the lowest living alien of each column
+ * and the bounding box of the living aliens are kept up to date as aliens are killed, so that
+ * the questions asked on every step (who can fire, has the formation reached the edge of the
+ * screen, is it wiped out) need not look at the whole grid.
+ * 
+ * The grid has room for the largest formation allowed, so that it can be copied as it is;
+ * a formation of nAlienBlockWidth x nAlienBlockHeight aliens uses the front of the arrays.
+ */
+struct AlienGrid {
+    static const int MaxColumns = 192;
+    static const int MaxRows = 64;
+    static const int MaxWordsPerRow = (MaxColumns + 63) / 64;
+    int nWordsPerRow;
+    int nAlive;                 // living aliens in the whole formation
+    int nExploding;             // aliens blowing up
+    // bounding box of the living aliens: first and last column, last row
+    int nLeftColumn;
+    int nRightColumn;
+    int nBottomRow;
+    uint64_t m_alive[MaxRows*MaxWordsPerRow];
+    uint64_t m_exploding[MaxRows*MaxWordsPerRow];
+    int8_t nColumnBottom[MaxColumns];   // row of the lowest living alien of each column; -1 when none is left
+    uint8_t nColumnAlive[MaxColumns];   // living aliens in each column
+    uint8_t nRowAlive[MaxRows];         // living aliens in each row
+
+
+    // Bring every alien of the grid of nAlienBlockWidth x nAlienBlockHeight to life
+    void revive() {
+        nWordsPerRow = (nAlienBlockWidth + 63) / 64;
+        for (int i = 0; i < nAlienBlockHeight; ++i)
+            for (int w = 0; w < nWordsPerRow; ++w) {
+                const int nBits = min(64, nAlienBlockWidth - 64*w);
+                m_alive[i*nWordsPerRow + w] = (nBits == 64) ? ~(uint64_t)0: ((uint64_t)1 << nBits) - 1;
+                m_exploding[i*nWordsPerRow + w] = 0;
+            }
+        for (int j = 0; j < nAlienBlockWidth; ++j) {
+            nColumnBottom[j] = (int8_t)(nAlienBlockHeight - 1);
+            nColumnAlive[j] = (uint8_t)nAlienBlockHeight;
+        }
+        for (int i = 0; i < nAlienBlockHeight; ++i) nRowAlive[i] = (uint8_t)nAlienBlockWidth;
+        nAlive = nAlienBlockWidth*nAlienBlockHeight;
+        nExploding = 0;
+        nLeftColumn = 0;
+        nRightColumn = nAlienBlockWidth - 1;
+        nBottomRow = nAlienBlockHeight - 1;
+    }
+
+
+    bool alive(int i, int j) const {
+        return (m_alive[i*nWordsPerRow + j / 64] >> (j % 64)) & 1;
+    }
+
+
+    // Alien (i, j) has been shot: from alive to exploding
+    void kill(int i, int j) {
+        assert(alive(i, j));
+        const uint64_t bit = (uint64_t)1 << (j % 64);
+        m_alive[i*nWordsPerRow + j / 64] &= ~bit;
+        m_exploding[i*nWordsPerRow + j / 64] |= bit;
+        nAlive --;
+        nExploding ++;
+        nRowAlive[i] --;
+        nColumnAlive[j] --;
+        if (nColumnAlive[j] == 0) nColumnBottom[j] = -1;
+        else if (nColumnBottom[j] == i)
+            while (! alive(nColumnBottom[j], j)) nColumnBottom[j] --;
+        // shrink the bounding box past the rows and columns left empty, if any
+        if (nAlive == 0) {
+            nLeftColumn = nRightColumn = nBottomRow = -1;
+            return;
+        }
+        while (nColumnAlive[nLeftColumn] == 0) nLeftColumn ++;
+        while (nColumnAlive[nRightColumn] == 0) nRightColumn --;
+        while (nRowAlive[nBottomRow] == 0) nBottomRow --;
+    }
+
+
+    // The explosion of alien (i, j) is over: from exploding to dead
+    void remove(int i, int j) {
+        assert((m_exploding[i*nWordsPerRow + j / 64] >> (j % 64)) & 1);
+        m_exploding[i*nWordsPerRow + j / 64] &= ~((uint64_t)1 << (j % 64));
+        nExploding --;
+    }
+};
+
+
+// Effects that last for a while, then change the state of the game when they are over
+enum EffectType {
+    EFFECT_ALIEN_EXPLOSION, // alien (i, j) blows up, then it is dead
+    EFFECT_PLAYER_HIT       // the player blows up, then it is back in the game
+};
+
+struct Effect {
+    unsigned nExpiry;   // step of the game at which the effect is over
+    EffectType type;
+    int i, j;
+};
+
+
+/**
+ * Timed effects in progress, in a fixed-capacity ring buffer in the order they started.
+ * 
+ * Any number of effects can overlap, and the work done on each step is proportional to the
+ * number of effects in progress. When the buffer is full, the oldest effect is cut short
+ * to make room for a new one.
+ */
+struct EffectQueue {
+    static const int Capacity = 64;
+    Effect m_effects[Capacity];
+    int m_nFirst;
+    int nCount;
+
+
+    EffectQueue(): m_nFirst(0), nCount(0) {}
+
+
+    void clear() { m_nFirst = nCount = 0; }
+
+
+    // Add an effect; if the oldest one had to make room for it, return true and copy it to *pEvicted
+    bool push(const Effect& effect, Effect* pEvicted) {
+        bool bEvicted = false;
+        if (nCount == Capacity) {
+            *pEvicted = m_effects[m_nFirst];
+            m_nFirst = (m_nFirst + 1) % Capacity;
+            nCount --;
+            bEvicted = true;
+        }
+        m_effects[(m_nFirst + nCount) % Capacity] = effect;
+        nCount ++;
+        return bEvicted;
+    }
+
+
+    // Remove the effects that are over at step nStep, calling end(effect) on each of them
+    template <typename F>
+    void expire(unsigned nStep, F end) {
+        int nKept = 0;
+        for (int k = 0; k < nCount; ++k) {
+            const Effect& effect = m_effects[(m_nFirst + k) % Capacity];
+            if (effect.nExpiry <= nStep) end(effect);
+            else m_effects[(m_nFirst + nKept++) % Capacity] = effect;
+        }
+        nCount = nKept;
+    }
+};
+
+// How long the explosions last, in seconds
+static const float fAlienExplosionTime = 0.6f;
+static const float fPlayerHitTime = 1.0f;
+
+// Width of the aliens and of the player on screen; the sprites in the atlas match them
+const int nAlienGlyphWidth = 3;
+const int nPlayerWidth = 3;
+
+// The simulation advances in fixed steps of this many seconds, whatever the frame rate
+static const float fTimeStep = 1.0f / 120.0f;
+// Longest stretch of time the simulation tries to catch up with after a slow frame
+static const float fMaxFrameLag = 0.25f;
+
+// Shots per second fired by the lowest alien of each column, when it is right above the
+// player and otherwise; turned into the chance of firing during one step of the simulation
+static const float fAlignedFireRate = 2.0f;
+static const float fRandomFireRate = 0.2f;
+const float fAlignedFireChance = 1.0f - expf(-fAlignedFireRate*fTimeStep);
+const float fRandomFireChance = 1.0f - expf(-fRandomFireRate*fTimeStep);
+
+// Arrow Left, Arrow Right, Spacebar, ESC, Pause
+static const int nPlayerKeys = 5;
+enum KeyMnemonics {
+    LEFT_ARROW,
+    RIGHT_ARROW,
+    SPACEBAR,
+    ESC,
+    PAUSE
+};
+
+
+// A shield is a block of obstacle cells; its strength is kept in the ObstacleGrid
+struct Shield {
+    static const int Length = 8;
+    static const int Height = 3;
+    static const int MaxStrength = 3;
+    int nX;
+    int nY;
+
+
+    // One shield every 30 columns, spread evenly across a board nWidth columns wide
+    static constexpr int count(int nWidth) { return nWidth/30 - 1 > 1 ? nWidth/30 - 1: 1; }
+    static constexpr int column(int i, int nWidth) { return (i+1)*nWidth/(count(nWidth)+1); }
+    // The shields stand on the same rows, above the player
+    static constexpr int row(int nHeight) { return nHeight - 6; }
+};
+
+
+/**
+ * Strength of the obstacle in every cell of the rows the shields stand on, row by row; 0 is
+ * a free cell. A bullet finds out what it hits with a single lookup, however many shields
+ * (or other obstacles) there are; there are none outside of these rows.
+ * 
+ * The grid is part of the GameState, which is copied whole for keyframes, telemetry and
+ * rollback, so it has a fixed size. Covering the whole board would take a megabyte at
+ * 1024x1024 and 32 MB at the tallest board; the band of the shields takes Rows*MaxWidth bytes.
+ * Obstacles placed on other rows need Rows raised, and a band that starts above them.
+ */
+struct ObstacleGrid {
+    static const int MaxWidth = 1024;
+    static const int Rows = Shield::Height;
+    int nTop;   // first row of the board covered
+    unsigned char m_strength[Rows*MaxWidth];
+
+
+    // Clear the grid, to cover the Rows rows of the board from nFirstRow
+    void reset(int nFirstRow) {
+        nTop = nFirstRow;
+        memset(m_strength, 0, sizeof(m_strength));
+    }
+
+
+    // Strength of the obstacle in cell (x, y), which must be covered by the grid
+    unsigned char& at(int x, int y) { return m_strength[(y - nTop)*nScreenWidth + x]; }
+    unsigned char at(int x, int y) const { return m_strength[(y - nTop)*nScreenWidth + x]; }
+
+
+    // Chip one point of strength off the obstacle in cell (x, y); false if there is none
+    bool hit(int x, int y) {
+        if (x < 0 || x >= nScreenWidth || (unsigned)(y - nTop) >= (unsigned)Rows) return false;
+        unsigned char& strength = at(x, y);
+        if (strength == 0) return false;
+        strength --;
+        return true;
+    }
+
+
+    // Put the shield on the board, at full strength
+    void place(const Shield& shield) {
+        for (int i = 0; i < Shield::Height; ++i)
+            for (int j = 0; j < Shield::Length; ++j) at(shield.nX + j, shield.nY + i) = Shield::MaxStrength;
+    }
+};
+
+
+// Colours of the cells on screen, as console attributes
+static const WORD COLOUR_TEXT = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_BLUE;
+static const WORD COLOUR_HUD = COLOUR_TEXT | FOREGROUND_INTENSITY;
+static const WORD COLOUR_PLAYER = FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+static const WORD COLOUR_EXPLOSION = FOREGROUND_RED | FOREGROUND_INTENSITY;
+static const WORD COLOUR_SHIELD = FOREGROUND_GREEN;
+static const WORD COLOUR_PLAYER_BULLET = COLOUR_HUD;
+static const WORD COLOUR_ALIEN_BULLET = FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY;
+// one colour per row of the formation, repeating
+static const WORD alienColours[4] = {
+    FOREGROUND_RED | FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+    FOREGROUND_GREEN | FOREGROUND_BLUE | FOREGROUND_INTENSITY,
+    FOREGROUND_RED | FOREGROUND_GREEN | FOREGROUND_INTENSITY,
+    FOREGROUND_BLUE | FOREGROUND_INTENSITY
+};
+
+
+inline CHAR_INFO MakeCell(wchar_t c, WORD wAttributes)
+{
+    CHAR_INFO cell;
+    cell.Char.UnicodeChar = c;
+    cell.Attributes = wAttributes;
+    return cell;
+}
+
+
+inline bool SameCell(const CHAR_INFO& a, const CHAR_INFO& b)
+{
+    return a.Char.UnicodeChar == b.Char.UnicodeChar && a.Attributes == b.Attributes;
+}
+
+
+// Screen buffer: the glyph and colour of every cell, row by row
+CHAR_INFO *screen = NULL;
+
+
+/**
+ * The span of cells [nLeft, nRight) drawn to on every row of a buffer the size of the
+ * screen; nLeft >= nRight on the rows nothing was drawn to. Two cells drawn to on the same
+ * row make one span of all the cells between them, which is cheaper to keep track of and
+ * to copy than the cells themselves.
+ */
+struct DirtySpans {
+    vector<int> m_nLeft;
+    vector<int> m_nRight;
+
+
+    void resize(int nRows) {
+        m_nLeft.assign(nRows, INT_MAX);
+        m_nRight.assign(nRows, 0);
+    }
+
+
+    // Cells [nLeft, nRight) of row y, clipped to the screen
+    void add(int y, int nLeft, int nRight) {
+        if (y < 0 || y >= nScreenHeight) return;
+        m_nLeft[y] = min(m_nLeft[y], max(nLeft, 0));
+        m_nRight[y] = max(m_nRight[y], min(nRight, nScreenWidth));
+    }
+
+
+    // Copy the cells of the spans from pFrom to pTo, the same size as the screen
+    void copy(const CHAR_INFO* pFrom, CHAR_INFO* pTo) const {
+        for (int y = 0; y < nScreenHeight; ++y)
+            if (m_nLeft[y] < m_nRight[y]) {
+                const int nOffset = y*nScreenWidth + m_nLeft[y];
+                memcpy(pTo + nOffset, pFrom + nOffset, (m_nRight[y] - m_nLeft[y])*sizeof(CHAR_INFO));
+            }
+    }
+
+
+    void clear() {
+        for (int y = 0; y < nScreenHeight; ++y) {
+            m_nLeft[y] = INT_MAX;
+            m_nRight[y] = 0;
+        }
+    }
+};
+
+// The cells of the screen buffer drawn over the still layers since the last frame was composed,
+// see Compositor: the moving sprites and the text
+DirtySpans overdrawn;
+
+
+// A rectangle of cells in the sprite atlas, stored row by row
+struct Sprite {
+    int nOffset;
+    int nWidth;
+    int nHeight;
+};
+
+
+/**
+ * All the artwork of the game, laid out once at startup in one contiguous block of cells.
+ * Every animation frame is a sprite of its own, so drawing one is a copy of its rows into
+ * the screen buffer, whatever its size.
+ */
+struct SpriteAtlas {
+    vector<CHAR_INFO> m_cells;
+
+
+    // Add the nWidth x nHeight cells of szArt, row by row and all of one colour, to the atlas
+    Sprite add(const wchar_t* szArt, WORD wAttributes, int nWidth, int nHeight = 1) {
+        assert((int)wcslen(szArt) == nWidth*nHeight);
+        Sprite sprite = {(int)m_cells.size(), nWidth, nHeight};
+        for (int k = 0; k < nWidth*nHeight; ++k) m_cells.push_back(MakeCell(szArt[k], wAttributes));
+        return sprite;
+    }
+
+
+    const CHAR_INFO* cells(const Sprite& sprite) const {
+        return m_cells.data() + sprite.nOffset;
+    }
+};
+
+SpriteAtlas atlas;
+// "graphical" representation of the aliens: two frames per row of the formation, and the
+// explosion of the aliens and of the player
+const Sprite alienSprites[4][2] = {
+    {atlas.add(L"<o>", alienColours[0], 3), atlas.add(L">o<", alienColours[0], 3)},
+    {atlas.add(L"}O{", alienColours[1], 3), atlas.add(L"-O-", alienColours[1], 3)},
+    {atlas.add(L"[T]", alienColours[2], 3), atlas.add(L"]+[", alienColours[2], 3)},
+    {atlas.add(L"(+)", alienColours[3], 3), atlas.add(L"-x-", alienColours[3], 3)}
+};
+const Sprite alienExplosionSprite = atlas.add(L"xxx", COLOUR_EXPLOSION, 3);
+const Sprite playerSprite = atlas.add(L"<I>", COLOUR_PLAYER, nPlayerWidth);
+const Sprite playerHitSprite = atlas.add(L"XXX", COLOUR_EXPLOSION, nPlayerWidth);
+// One cell per strength of an obstacle, from 0 (free)
+//const Sprite shieldPalette = atlas.add(L" \x2591\x2592\x2593", COLOUR_SHIELD, Shield::MaxStrength + 1);
+const Sprite shieldPalette = atlas.add(L" -=#", COLOUR_SHIELD, Shield::MaxStrength + 1);
+
+
+// Copy the nWidth x nHeight cells at pCells into pDest, a buffer nStride cells wide
+inline void BlitUnclipped(CHAR_INFO* pDest, int nStride, const CHAR_INFO* pCells, int nWidth, int nHeight)
+{
+    for (int i = 0; i < nHeight; ++i, pCells += nWidth, pDest += nStride)
+        for (int k = 0; k < nWidth; ++k) pDest[k] = pCells[k];
+}
+
+
+// Copy a sprite into pDest, a buffer the size of the screen, with its top left corner at (x, y), clipped to the screen
+inline void Blit(const Sprite& sprite, int x, int y, CHAR_INFO* pDest = screen)
+{
+    const int nLeft = max(0, -x), nRight = min(sprite.nWidth, nScreenWidth - x);
+    if (nLeft >= nRight) return;
+    const CHAR_INFO* pRow = atlas.cells(sprite);
+    for (int i = 0; i < sprite.nHeight; ++i, pRow += sprite.nWidth) {
+        if (y + i < 0 || y + i >= nScreenHeight) continue;
+        memcpy(pDest + (y + i)*nScreenWidth + x + nLeft, pRow + nLeft, (nRight - nLeft)*sizeof(CHAR_INFO));
+    }
+}
+
+struct Bullet {
+    bool visible;
+    float x;
+    float y;
+    wchar_t glyph;
+    Bullet(wchar_t _glyph=L'|'): visible(false), x(0), y(0), glyph(_glyph) {};
+};
+
+// the aliens speed up each time they reach a side, down to this delay
+static const float fMinAnimDelay = 0.1f;
+
+
+/**
+ * Kernels over whole arrays, in versions for several instruction sets: plain C++, SSE2 and
+ * AVX2. The vector versions give exactly the same results as the plain ones (no fused
+ * multiply-add, and roundf()'s rounding of halfway cases away from zero), so the choice
+ * made at startup, after what the CPU supports, never changes how a game plays out.
+ */
+struct SimdKernels {
+    const char* szName;
+    // Set nCells cells from pCells on to `cell`
+    void (*pfnFill)(CHAR_INFO* pCells, int nCells, CHAR_INFO cell);
+    // Move n bullets: y[k] += vy[k]*dt
+    void (*pfnMoveBullets)(float* y, const float* vy, int n, float dt);
+    /**
+     * First pass over n bullets moved down the board, from row[k] to the row of y[k], which
+     * goes to pRows[k]. pCheck[k] is set IFF bullet k must be looked at cell by cell: the rows
+     * it entered (or the one it is in, if it stayed there) cross the band of rows
+     * [nBandTop, nBandBottom] where the obstacles are, or it reached row nBottom.
+     */
+    void (*pfnClassifyBullets)(const float* y, const int* row, int n, int nBandTop, int nBandBottom, int nBottom,
+        int* pRows, unsigned char* pCheck);
+};
+
+
+void FillScalar(CHAR_INFO* pCells, int nCells, CHAR_INFO cell)
+{
+    for (int k = 0; k < nCells; ++k) pCells[k] = cell;
+}
+
+
+void MoveBulletsScalar(float* y, const float* vy, int n, float dt)
+{
+    for (int k = 0; k < n; ++k) y[k] += vy[k]*dt;
+}
+
+
+void ClassifyBulletsScalar(const float* y, const int* row, int n, int nBandTop, int nBandBottom, int nBottom,
+    int* pRows, unsigned char* pCheck)
+{
+    for (int k = 0; k < n; ++k) {
+        const int nY = (int)roundf(y[k]);
+        const int nFirst = min(row[k] + 1, nY);
+        pRows[k] = nY;
+        pCheck[k] = (nY >= nBandTop && nFirst <= nBandBottom) || nY >= nBottom;
+    }
+}
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SIMD_X86
+// Functions using AVX2 are compiled for it even when the rest of the program is not
+#if defined(_MSC_VER)
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+
+void FillSse2(CHAR_INFO* pCells, int nCells, CHAR_INFO cell)
+{
+    const int nPerVector = 16 / sizeof(CHAR_INFO);
+    alignas(16) CHAR_INFO pattern[nPerVector];
+    for (int i = 0; i < nPerVector; ++i) pattern[i] = cell;
+    const __m128i v = _mm_load_si128((const __m128i*)pattern);
+    int k = 0;
+    for (; k < nCells && ((uintptr_t)(pCells + k) & 15) != 0; ++k) pCells[k] = cell;
+    for (; k + nPerVector <= nCells; k += nPerVector) _mm_store_si128((__m128i*)(pCells + k), v);
+    for (; k < nCells; ++k) pCells[k] = cell;
+}
+
+
+void MoveBulletsSse2(float* y, const float* vy, int n, float dt)
+{
+    const __m128 vdt = _mm_set1_ps(dt);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) _mm_storeu_ps(y + k, _mm_add_ps(_mm_loadu_ps(y + k), _mm_mul_ps(_mm_loadu_ps(vy + k), vdt)));
+    for (; k < n; ++k) y[k] += vy[k]*dt;
+}
+
+
+// (int)roundf() of 4 floats
+inline __m128i RoundSse2(__m128 v)
+{
+    const __m128i t = _mm_cvttps_epi32(v);
+    const __m128 fraction = _mm_sub_ps(v, _mm_cvtepi32_ps(t));    // exact
+    const __m128i up = _mm_castps_si128(_mm_cmpge_ps(fraction, _mm_set1_ps(0.5f)));     // -1 where rounding up
+    const __m128i down = _mm_castps_si128(_mm_cmple_ps(fraction, _mm_set1_ps(-0.5f)));  // -1 where rounding down
+    return _mm_add_epi32(_mm_sub_epi32(t, up), down);
+}
+
+
+void ClassifyBulletsSse2(const float* y, const int* row, int n, int nBandTop, int nBandBottom, int nBottom,
+    int* pRows, unsigned char* pCheck)
+{
+    const __m128i one = _mm_set1_epi32(1);
+    // a >= b is b - 1 < a, and a <= b is a < b + 1
+    const __m128i bandTop = _mm_set1_epi32(nBandTop - 1), bandBottom = _mm_set1_epi32(nBandBottom + 1);
+    const __m128i bottom = _mm_set1_epi32(nBottom - 1);
+    int k = 0;
+    for (; k + 4 <= n; k += 4) {
+        const __m128i nY = RoundSse2(_mm_loadu_ps(y + k));
+        const __m128i nNext = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(row + k)), one);
+        const __m128i bEntered = _mm_cmpgt_epi32(nY, nNext);   // min() needs SSE4.1
+        const __m128i nFirst = _mm_or_si128(_mm_and_si128(bEntered, nNext), _mm_andnot_si128(bEntered, nY));
+        const __m128i bCheck = _mm_or_si128(_mm_and_si128(_mm_cmpgt_epi32(nY, bandTop), _mm_cmplt_epi32(nFirst, bandBottom)),
+            _mm_cmpgt_epi32(nY, bottom));
+        _mm_storeu_si128((__m128i*)(pRows + k), nY);
+        const int nMask = _mm_movemask_ps(_mm_castsi128_ps(bCheck));
+        for (int i = 0; i < 4; ++i) pCheck[k + i] = (nMask >> i) & 1;
+    }
+    ClassifyBulletsScalar(y + k, row + k, n - k, nBandTop, nBandBottom, nBottom, pRows + k, pCheck + k);
+}
+
+
+TARGET_AVX2 void FillAvx2(CHAR_INFO* pCells, int nCells, CHAR_INFO cell)
+{
+    const int nPerVector = 32 / sizeof(CHAR_INFO);
+    alignas(32) CHAR_INFO pattern[nPerVector];
+    for (int i = 0; i < nPerVector; ++i) pattern[i] = cell;
+    const __m256i v = _mm256_load_si256((const __m256i*)pattern);
+    int k = 0;
+    // stores that straddle two cache lines take twice as long: up to the first aligned cell one by one
+    for (; k < nCells && ((uintptr_t)(pCells + k) & 31) != 0; ++k) pCells[k] = cell;
+    for (; k + 2*nPerVector <= nCells; k += 2*nPerVector) {
+        _mm256_store_si256((__m256i*)(pCells + k), v);
+        _mm256_store_si256((__m256i*)(pCells + k + nPerVector), v);
+    }
+    for (; k + nPerVector <= nCells; k += nPerVector) _mm256_store_si256((__m256i*)(pCells + k), v);
+    for (; k < nCells; ++k) pCells[k] = cell;
+}
+
+
+// Lanes [0, n) of a mask for _mm256_maskload/maskstore, n <= 8
+TARGET_AVX2 inline __m256i TailMaskAvx2(int n)
+{
+    return _mm256_cmpgt_epi32(_mm256_set1_epi32(n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+
+TARGET_AVX2 void MoveBulletsAvx2(float* y, const float* vy, int n, float dt)
+{
+    const __m256 vdt = _mm256_set1_ps(dt);
+    int k = 0;
+    for (; k + 8 <= n; k += 8)
+        _mm256_storeu_ps(y + k, _mm256_add_ps(_mm256_loadu_ps(y + k), _mm256_mul_ps(_mm256_loadu_ps(vy + k), vdt)));
+    if (k < n) {
+        // the last bullets, masked: the slots past them are left alone
+        const __m256i mask = TailMaskAvx2(n - k);
+        const __m256 v = _mm256_add_ps(_mm256_maskload_ps(y + k, mask), _mm256_mul_ps(_mm256_maskload_ps(vy + k, mask), vdt));
+        _mm256_maskstore_ps(y + k, mask, v);
+    }
+}
+
+
+// (int)roundf() of 8 floats
+TARGET_AVX2 inline __m256i RoundAvx2(__m256 v)
+{
+    const __m256i t = _mm256_cvttps_epi32(v);
+    const __m256 fraction = _mm256_sub_ps(v, _mm256_cvtepi32_ps(t));
+    const __m256i up = _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(0.5f), _CMP_GE_OQ));
+    const __m256i down = _mm256_castps_si256(_mm256_cmp_ps(fraction, _mm256_set1_ps(-0.5f), _CMP_LE_OQ));
+    return _mm256_add_epi32(_mm256_sub_epi32(t, up), down);
+}
+
+
+TARGET_AVX2 void ClassifyBulletsAvx2(const float* y, const int* row, int n, int nBandTop, int nBandBottom, int nBottom,
+    int* pRows, unsigned char* pCheck)
+{
+    const __m256i one = _mm256_set1_epi32(1);
+    const __m256i bandTop = _mm256_set1_epi32(nBandTop - 1), bandBottom = _mm256_set1_epi32(nBandBottom + 1);
+    const __m256i bottom = _mm256_set1_epi32(nBottom - 1);
+    for (int k = 0; k < n; k += 8) {
+        // past the last bullet, the lanes are masked out on the way in and out
+        const __m256i mask = TailMaskAvx2(n - k);
+        const __m256i nY = RoundAvx2(_mm256_maskload_ps(y + k, mask));
+        const __m256i nFirst = _mm256_min_epi32(_mm256_add_epi32(_mm256_maskload_epi32(row + k, mask), one), nY);
+        const __m256i bCheck = _mm256_or_si256(_mm256_and_si256(_mm256_cmpgt_epi32(nY, bandTop), _mm256_cmpgt_epi32(bandBottom, nFirst)),
+            _mm256_cmpgt_epi32(nY, bottom));
+        _mm256_maskstore_epi32(pRows + k, mask, nY);
+        const int nMask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(bCheck, mask)));
+        for (int i = 0; i < 8 && k + i < n; ++i) pCheck[k + i] = (nMask >> i) & 1;
+    }
+}
+
+
+// True IFF the CPU, and the operating system, support AVX2
+bool CpuHasAvx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    const bool bOsSavesYmm = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return bOsSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+
+// True IFF the CPU supports SSE2, which every 64-bit one does
+bool CpuHasSse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+#endif
+
+
+static const SimdKernels simdScalar = { "scalar", FillScalar, MoveBulletsScalar, ClassifyBulletsScalar };
+#if defined(SIMD_X86)
+static const SimdKernels simdSse2 = { "sse2", FillSse2, MoveBulletsSse2, ClassifyBulletsSse2 };
+static const SimdKernels simdAvx2 = { "avx2", FillAvx2, MoveBulletsAvx2, ClassifyBulletsAvx2 };
+#endif
+
+
+// The kernels for the widest instruction set named szName (if not NULL) the CPU supports; NULL if there is none
+const SimdKernels* FindSimdKernels(const char* szName)
+{
+    const SimdKernels* candidates[] = {
+#if defined(SIMD_X86)
+        CpuHasAvx2() ? &simdAvx2: NULL,
+        CpuHasSse2() ? &simdSse2: NULL,
+#endif
+        &simdScalar
+    };
+    for (const SimdKernels* pKernels: candidates)
+        if (pKernels != NULL && (szName == NULL || strcmp(pKernels->szName, szName) == 0)) return pKernels;
+    return NULL;
+}
+
+// The kernels in use, the best ones for the CPU unless told otherwise
+SimdKernels simd = *FindSimdKernels(NULL);
+
+
+/**
+ * Fixed-capacity pool of bullets, stored as a structure of arrays.
+ * 
+ * Live bullets are kept packed at the front of the arrays, and the free slots are the ones
+ * past `nLive`: acquire() takes the first free slot, release() moves the last live bullet
+ * into the slot it frees. Both are O(1), and the loops over the bullets run on the range
+ * [0, nLive) only, with no test for visibility, so that the compiler can vectorize them.
+ * The arrays have room for the largest pool allowed; `nCapacity` bullets of them are used.
+ */
+struct BulletPool {
+    static const int MaxCapacity = 256;
+    int nCapacity;
+    int nLive;
+    wchar_t glyph;
+    float x[MaxCapacity];
+    float y[MaxCapacity];
+    float vy[MaxCapacity];  // vertical speed, in cells per second
+    int row[MaxCapacity];   // row of the cell checked last for collisions
+
+
+    // the arrays are zeroed too: a pool is copied whole, into GameState and keyframes
+    BulletPool(wchar_t _glyph = L'*'): nCapacity(0), nLive(0), glyph(_glyph), x(), y(), vy(), row() {}
+
+
+    // Make room for `nBullets` live bullets and release them all
+    void reserve(int nBullets) {
+        assert(nBullets <= MaxCapacity);
+        nCapacity = nBullets;
+        nLive = 0;
+    }
+
+
+    void clear() { nLive = 0; }
+
+
+    // Launch a new bullet; false if all bullets are already in flight
+    bool acquire(float fX, float fY, float fVy) {
+        if (nLive == nCapacity) return false;
+        x[nLive] = fX;
+        y[nLive] = fY;
+        vy[nLive] = fVy;
+        row[nLive] = (int)roundf(fY);
+        ++nLive;
+        return true;
+    }
+
+
+    // Remove bullet k; the last live bullet takes its place
+    void release(int k) {
+        assert(0 <= k && k < nLive);
+        --nLive;
+        x[k] = x[nLive];
+        y[k] = y[nLive];
+        vy[k] = vy[nLive];
+        row[k] = row[nLive];
+    }
+
+
+    void move(float fElapsedTime) { simd.pfnMoveBullets(y, vy, nLive, fElapsedTime); }
+};
+
+
+// Fast pseudo-random number generator for the game logic (Marsaglia's xorshift32)
+struct Random {
+    uint32_t m_state;
+
+
+    Random(uint32_t seed = 0) { m_state = (seed != 0) ? seed : 0x9E3779B9u; }
+
+
+    uint32_t next() {
+        m_state ^= m_state << 13;
+        m_state ^= m_state >> 17;
+        m_state ^= m_state << 5;
+        return m_state;
+    }
+
+
+    // Uniformly distributed in [0, 1)
+    float nextFloat() { return (float)(next() >> 8) * (1.0f / 16777216.0f); }
+};
+
+
+/**
+ * The whole state of a game, in one block of memory with no pointer in it: a game can be
+ * copied with memcpy (to keep a snapshot of it, or to hand it to another thread) and any
+ * number of games can be played side by side, each in a GameState of its own.
+ * 
+ * The fields read at every step come first, so that they share the first cache lines; the
+ * bulky arrays follow. The arrays have room for the largest board allowed (see
+ * ConfigureBoard()) and a game uses the front of them.
+ */
+struct GameState {
+    unsigned nStep;             // steps of the simulation since the start of the game, the clock of the effects
+    float fPlayerX;
+    int nPlayerY;
+    float fPlayerVx;
+    float fPlayerBulletSpeed;
+    int nAlienBlockX;
+    int nAlienBlockY;
+    int nAlienStep;             // 1: left to right, -1: right to left
+    float fAlienBulletSpeed;    // how fast alien bullets move
+    float fAnimElapsed;         // counter for animation time
+    float fAnimDelay;           // delay between animations
+    int nFrameOffset;
+    int nScore;
+    int nLives;                 // number of player lives
+    int nGame;                  // games started before this one in the session, from 0
+    bool bGameOver;
+    bool bPlayerHit;            // true IFF player has been hit
+    bool bKeyPressed[nPlayerKeys];
+    bool bKeyHold[nPlayerKeys]; // used to latch the key presses
+    Random rng;
+    Bullet bullet;              // the player's bullet
+    EffectQueue effects;
+    BulletPool alienBullets;    // bullets fired by the aliens
+    int nShields;
+    Shield shields[ObstacleGrid::MaxWidth / 30];    // barriers to protect the player
+    ObstacleGrid obstacles;
+    AlienGrid aliens;
+};
+
+static_assert(is_trivially_copyable<GameState>::value, "a GameState must be copyable with memcpy");
+
+
+/**
+ * The size of the board, as seen by the kernels run at every step and frame, which are
+ * templates taking one of these. RuntimeBoard reads the size set by ConfigureBoard() and
+ * fits any board. FixedBoard has it built in: the compiler folds the offsets into
+ * constants, looks the shields up in a table computed at compile time and unrolls the
+ * loops over the grid and the shields.
+ */
+struct RuntimeBoard {
+    static int width() { return nScreenWidth; }
+    static int height() { return nScreenHeight; }
+    static int gridWidth() { return nAlienBlockWidth; }
+    static int gridHeight() { return nAlienBlockHeight; }
+    static int wordsPerRow() { return (nAlienBlockWidth + 63) / 64; }
+    static int shields() { return Shield::count(nScreenWidth); }
+    static int shieldColumn(int i) { return Shield::column(i, nScreenWidth); }
+};
+
+
+template <int Width, int Height, int GridWidth, int GridHeight>
+struct FixedBoard {
+    struct ShieldTable {
+        int nColumn[Shield::count(Width)];
+    };
+
+
+    static constexpr ShieldTable makeShieldTable() {
+        ShieldTable table = {};
+        for (int i = 0; i < Shield::count(Width); ++i) table.nColumn[i] = Shield::column(i, Width);
+        return table;
+    }
+
+
+    static constexpr ShieldTable shieldTable = makeShieldTable();
+    static constexpr int width() { return Width; }
+    static constexpr int height() { return Height; }
+    static constexpr int gridWidth() { return GridWidth; }
+    static constexpr int gridHeight() { return GridHeight; }
+    static constexpr int wordsPerRow() { return (GridWidth + 63) / 64; }
+    static constexpr int shields() { return Shield::count(Width); }
+    static constexpr int shieldColumn(int i) { return shieldTable.nColumn[i]; }
+
+
+    // True IFF the board set by ConfigureBoard() is this one
+    static bool configured() {
+        return nScreenWidth == Width && nScreenHeight == Height && nAlienBlockWidth == GridWidth && nAlienBlockHeight == GridHeight;
+    }
+};
+
+// The board of the standard game, 120x30 with 10x4 aliens, has kernels of its own
+typedef FixedBoard<120, 30, 10, 4> StandardBoard;
+
+
+/**
+ * The seed of game nGame of a session started from `seed`: far apart for games next to each
+ * other. Each game is seeded from its number alone, so it plays out the same whether the
+ * games are played one after the other, spread over threads or played back.
+ */
+inline uint32_t GameSeed(uint32_t seed, int nGame)
+{
+    uint32_t h = seed ^ (0x9E3779B9u * (uint32_t)(nGame + 1));
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    return h;
+}
+
+
+// Start game nGame of the session seeded from `seed`, on the board set by ConfigureBoard()
+void InitGame(GameState& state, uint32_t seed, int nGame)
+{
+    // zero everything, the unused ends of the arrays included, so that copies compare equal
+    state = GameState();
+    state.rng = Random(GameSeed(seed, nGame));
+    state.nGame = nGame;
+    state.fPlayerX = (float)(nScreenWidth - nPlayerWidth) / 2.0f;
+    state.nPlayerY = nScreenHeight - 1;
+    state.fPlayerVx = 12.0f;
+    state.fPlayerBulletSpeed = -20.0f;
+    state.nAlienBlockX = 2;
+    state.nAlienBlockY = 2;
+    state.nStep = 0;
+    state.effects.clear();
+    state.fAlienBulletSpeed = 20.0f;
+    // one shield every 30 columns, spread evenly across the board
+    state.nShields = Shield::count(nScreenWidth);
+    state.obstacles.reset(Shield::row(nScreenHeight));
+    for (int i = 0; i < state.nShields; ++i) {
+        state.shields[i] = Shield{Shield::column(i, nScreenWidth), Shield::row(nScreenHeight)};
+        state.obstacles.place(state.shields[i]);
+    }
+    state.nAlienStep = 1;
+    state.bGameOver = false;
+    state.bPlayerHit = false;
+    state.fAnimElapsed = 0.0f;
+    state.fAnimDelay = 0.35f;
+    state.nFrameOffset = 0;
+    state.nScore = 0;
+    state.nLives = 3;
+    state.bullet = Bullet();
+    // initialize all aliens to state "Alive"
+    state.aliens.revive();
+    state.alienBullets = BulletPool(L'*');
+    state.alienBullets.reserve(nMaxAlienBullets);
+    for (int k = 0; k < nPlayerKeys; ++k) state.bKeyHold[k] = true;
+}
+
+
+inline bool AlienFire(GameState& state, int i, int j)
+{
+    return state.alienBullets.acquire((float)(state.nAlienBlockX + 6*j + 1), (float)(state.nAlienBlockY + 2*i + 1), state.fAlienBulletSpeed);
+}
+
+
+template <class Board = RuntimeBoard>
+inline void ClearBuffer(CHAR_INFO* pScreenBuf)
+{
+    simd.pfnFill(pScreenBuf, Board::width()*Board::height(), MakeCell(L' ', COLOUR_TEXT));
+}
+
+
+// Draw the formation into pScreenBuf, a buffer the size of the screen
+template <class Board>
+void DrawAliens(const GameState& state, CHAR_INFO* pScreenBuf)
+{
+    const AlienGrid& aliens = state.aliens;
+    const int nWordsPerRow = Board::wordsPerRow();
+    for (int i = 0; i < Board::gridHeight(); ++i) {
+        // explosions can linger a little outside of the screen, as the edges follow the living aliens
+        if (state.nAlienBlockY + 2*i >= Board::height()) break;
+        const int nY = state.nAlienBlockY + 2*i;
+        const Sprite& sprite = alienSprites[i % 4][state.nFrameOffset / nAlienGlyphWidth];
+        const CHAR_INFO* pCells = atlas.cells(sprite);
+        const int nWidth = sprite.nWidth, nHeight = sprite.nHeight;
+        CHAR_INFO* const pRow = pScreenBuf + nY*Board::width() + state.nAlienBlockX;
+        // visit the set bits only: the dead aliens cost nothing
+        for (int w = 0; w < nWordsPerRow; ++w) {
+            // the living aliens are always on the screen, the formation turns around at its edges
+            for (uint64_t bits = aliens.m_alive[i*nWordsPerRow + w]; bits != 0; bits &= bits - 1) // alive
+                BlitUnclipped(pRow + (64*w + LowestBit(bits))*6, Board::width(), pCells, nWidth, nHeight);
+            for (uint64_t bits = aliens.m_exploding[i*nWordsPerRow + w]; bits != 0; bits &= bits - 1) // exploding
+                Blit(alienExplosionSprite, state.nAlienBlockX + (64*w + LowestBit(bits))*6, nY, pScreenBuf);
+        }
+    }
+}
+
+
+/**
+ * Check whether a bullet in cell (nBulletX, nBulletY) is about to hit a living alien, i.e. one
+ * in the cell right above it. The grid cell is worked out from the position of the formation:
+ * alien (i, j) occupies row `nAlienBlockY + 2*i`, columns `nAlienBlockX + 6*j` to `nAlienBlockX + 6*j + 2`.
+ */
+template <class Board>
+bool HitAlien(const GameState& state, int nBulletX, int nBulletY, int* iAlien, int* jAlien) {
+    const int dy = nBulletY - 1 - state.nAlienBlockY;
+    const int dx = nBulletX - state.nAlienBlockX;
+    if (dy < 0 || dx < 0 || dy % 2 != 0 || dx % 6 >= nAlienGlyphWidth) return false;
+    const int i = dy / 2, j = dx / 6;
+    if (i >= Board::gridHeight() || j >= Board::gridWidth() || ! state.aliens.alive(i, j))
+        return false;
+    *iAlien = i;
+    *jAlien = j;
+    return true;
+}
+
+
+// The moving sprites are drawn straight to the screen buffer, and noted in `overdrawn`
+void DrawPlayer(const GameState& state)
+{
+    const int nX = (int)roundf(state.fPlayerX);
+    Blit(state.bPlayerHit ? playerHitSprite: playerSprite, nX, state.nPlayerY);
+    overdrawn.add(state.nPlayerY, nX, nX + nPlayerWidth);
+}
+
+
+template <class Board>
+inline void DrawBullets(const BulletPool& alienBullets, const Bullet* pBullet)
+{
+    // player
+    int nBulletY = (int)roundf(pBullet->y);
+    int nBulletX = (int)roundf(pBullet->x);
+    if (pBullet->visible) {
+        screen[nBulletY*Board::width() + nBulletX] = MakeCell(pBullet->glyph, COLOUR_PLAYER_BULLET);
+        overdrawn.add(nBulletY, nBulletX, nBulletX + 1);
+    }
+    // aliens
+    const CHAR_INFO cell = MakeCell(alienBullets.glyph, COLOUR_ALIEN_BULLET);
+    for (int k = 0; k < alienBullets.nLive; ++k) {
+        int nX = (int)roundf(alienBullets.x[k]);
+        int nY = (int)roundf(alienBullets.y[k]);
+        screen[nY*Board::width() + nX] = cell;
+        overdrawn.add(nY, nX, nX + 1);
+    }
+}
+
+
+// Draw the shields into pScreenBuf, a buffer the size of the screen
+template <class Board>
+void DrawShields(const GameState& state, CHAR_INFO* pScreenBuf)
+{
+    const CHAR_INFO* pPalette = atlas.cells(shieldPalette);
+    pScreenBuf += Shield::row(Board::height())*Board::width();
+    // the rows of the obstacle grid are those of the shields, with the same stride as the screen
+    const unsigned char* pStrength = state.obstacles.m_strength;
+    for (int k = 0; k < Board::shields(); ++k) {
+        const int nX = Board::shieldColumn(k);
+        for (int i = 0; i < Shield::Height; ++i) {
+            const int nRowOffset = i*Board::width() + nX;
+            for (int j = 0; j < Shield::Length; ++j)
+                pScreenBuf[nRowOffset + j] = pPalette[pStrength[nRowOffset + j]];
+        }
+    }
+}
+
+
+
+// Phases of a frame timed by the profiler; input and collision are part of update
+enum ProfilePhase {
+    PHASE_INPUT,
+    PHASE_UPDATE,
+    PHASE_COLLISION,
+    PHASE_DRAW,
+    PHASE_PRESENT,
+    PHASE_FRAME,    // the whole frame, including the wait for the next one
+    nProfilePhases
+};
+const char* szPhaseNames[nProfilePhases] = {"input", "update", "collision", "draw", "present", "frame"};
+
+
+/**
+ * Collects the time spent in each phase of the frames, as reported by `ProfileScope`.
+ * 
+ * The last `HistoryLength` frames are kept for the on-screen statistics. Optionally, the
+ * timings are also streamed to a CSV file (one row per frame) and to a trace file in the
+ * Chrome trace event format (one event per scope), to be opened with chrome://tracing
+ * or https://ui.perfetto.dev.
+ */
+struct Profiler {
+    static const int HistoryLength = 256;
+    bool bEnabled;  // false: scopes are not timed at all
+    float m_frameTime[nProfilePhases];  // microseconds spent in each phase by the current frame
+    float m_history[nProfilePhases][HistoryLength];
+    int m_nFrames;
+    chrono::steady_clock::time_point m_tpStart;
+    chrono::steady_clock::time_point m_tpFrame; // start of the current frame
+    ofstream m_csv;
+    ofstream m_trace;
+    bool m_bFirstEvent;
+
+
+    Profiler(): bEnabled(false), m_nFrames(0), m_bFirstEvent(true) {
+        memset(m_frameTime, 0, sizeof(m_frameTime));
+        memset(m_history, 0, sizeof(m_history));
+        m_tpStart = m_tpFrame = chrono::steady_clock::now();
+    }
+
+
+    ~Profiler() {
+        if (m_trace.is_open()) m_trace << "\n]}\n";
+    }
+
+
+    // Start timing the scopes, from a frame starting now
+    void enable() {
+        bEnabled = true;
+        m_tpStart = m_tpFrame = chrono::steady_clock::now();
+    }
+
+
+    void openCsv(const string& path) {
+        m_csv.open(path);
+        if (! m_csv) throw runtime_error("cannot create " + path);
+        m_csv << "frame";
+        for (int k = 0; k < nProfilePhases; ++k) m_csv << "," << szPhaseNames[k] << "_us";
+        m_csv << "\n";
+    }
+
+
+    void openTrace(const string& path) {
+        m_trace.open(path);
+        if (! m_trace) throw runtime_error("cannot create " + path);
+        m_trace << fixed << setprecision(3) << "{\"traceEvents\":[";
+    }
+
+
+    void record(ProfilePhase phase, chrono::steady_clock::time_point t0, chrono::steady_clock::time_point t1) {
+        chrono::duration<float, micro> elapsed = t1 - t0;
+        m_frameTime[phase] += elapsed.count();
+        if (m_trace.is_open()) {
+            chrono::duration<double, micro> start = t0 - m_tpStart;
+            m_trace << (m_bFirstEvent ? "\n": ",\n") << "{\"name\":\"" << szPhaseNames[phase]
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << start.count()
+                << ",\"dur\":" << elapsed.count() << "}";
+            m_bFirstEvent = false;
+        }
+    }
+
+
+    // Close the current frame and start the next one
+    void endFrame() {
+        if (! bEnabled) return;
+        auto now = chrono::steady_clock::now();
+        record(PHASE_FRAME, m_tpFrame, now);
+        m_tpFrame = now;
+        const int nSlot = m_nFrames++ % HistoryLength;
+        for (int k = 0; k < nProfilePhases; ++k) m_history[k][nSlot] = m_frameTime[k];
+        if (m_csv.is_open()) {
+            m_csv << m_nFrames;
+            for (int k = 0; k < nProfilePhases; ++k) m_csv << "," << m_frameTime[k];
+            m_csv << "\n";
+        }
+        memset(m_frameTime, 0, sizeof(m_frameTime));
+    }
+
+
+    // Minimum, average and 99th percentile of the time spent in a phase over the last frames
+    void stats(ProfilePhase phase, float* pMin, float* pAvg, float* pP99) const {
+        const int nCount = m_nFrames < HistoryLength ? m_nFrames: HistoryLength;
+        float samples[HistoryLength];
+        float fSum = 0.0f;
+        *pMin = *pAvg = *pP99 = 0.0f;
+        if (nCount == 0) return;
+        memcpy(samples, m_history[phase], nCount*sizeof(float));
+        for (int k = 0; k < nCount; ++k) fSum += samples[k];
+        const int nP99 = (nCount*99 + 99) / 100 - 1;
+        nth_element(samples, samples + nP99, samples + nCount);
+        *pP99 = samples[nP99];
+        *pMin = *min_element(samples, samples + nCount);
+        *pAvg = fSum / nCount;
+    }
+};
+
+Profiler profiler;
+
+
+// Times the enclosing block as one phase of the frame
+struct ProfileScope {
+    ProfilePhase m_phase;
+    bool m_bActive;
+    chrono::steady_clock::time_point m_t0;
+
+
+    ProfileScope(ProfilePhase phase): m_phase(phase), m_bActive(profiler.bEnabled) {
+        if (m_bActive) m_t0 = chrono::steady_clock::now();
+    }
+
+
+    ~ProfileScope() {
+        if (m_bActive) profiler.record(m_phase, m_t0, chrono::steady_clock::now());
+    }
+};
+
+
+// Copy a line of text into the screen buffer at (x, y), cutting it at the edge of the screen
+void DrawString(int x, int y, const char* szText, WORD wAttributes = COLOUR_TEXT)
+{
+    int k = 0;
+    for (; szText[k] != '\0' && x + k < nScreenWidth; ++k)
+        screen[y*nScreenWidth + x + k] = MakeCell((wchar_t)szText[k], wAttributes);
+    overdrawn.add(y, x, x + k);
+}
+
+
+/**
+ * Frame times over a rolling window of the last frames, so that the frame rate shown on
+ * screen is an average rather than the reciprocal of a single, noisy sample.
+ */
+struct FrameStats {
+    static const int WindowLength = 64;
+    float m_samples[WindowLength];
+    int m_nCount;
+    int m_nNext;
+    double m_fSum;
+
+
+    FrameStats(): m_nCount(0), m_nNext(0), m_fSum(0.0) {}
+
+
+    void add(float fFrameTime) {
+        if (m_nCount == WindowLength) m_fSum -= m_samples[m_nNext];
+        else ++m_nCount;
+        m_samples[m_nNext] = fFrameTime;
+        m_fSum += fFrameTime;
+        m_nNext = (m_nNext + 1) % WindowLength;
+        // start over from the samples now and then, so that rounding errors do not pile up
+        if (m_nNext == 0) {
+            m_fSum = 0.0;
+            for (int k = 0; k < m_nCount; ++k) m_fSum += m_samples[k];
+        }
+    }
+
+
+    // Average frame time, in seconds
+    float average() const { return m_nCount > 0 ? (float)(m_fSum / m_nCount): 0.0f; }
+
+
+    float fps() const {
+        const float fAverage = average();
+        return fAverage > 0.0f ? 1.0f / fAverage: 0.0f;
+    }
+};
+
+FrameStats frameStats;
+
+
+// Time from a key press to the step of the simulation that sees it, over the last presses
+struct InputLatency {
+    static const int WindowLength = 64;
+    float m_samples[WindowLength];
+    int m_nCount;
+    int m_nNext;
+
+
+    InputLatency(): m_nCount(0), m_nNext(0) {}
+
+
+    void add(float fLatency) {
+        m_samples[m_nNext] = fLatency;
+        m_nNext = (m_nNext + 1) % WindowLength;
+        if (m_nCount < WindowLength) ++m_nCount;
+    }
+
+
+    // Average and longest latency, in seconds
+    void stats(float* pAverage, float* pMax) const {
+        float fSum = 0.0f, fMax = 0.0f;
+        for (int k = 0; k < m_nCount; ++k) {
+            fSum += m_samples[k];
+            fMax = max(fMax, m_samples[k]);
+        }
+        *pAverage = m_nCount > 0 ? fSum / m_nCount: 0.0f;
+        *pMax = fMax;
+    }
+};
+
+InputLatency inputLatency;
+
+
+// Draw the profiling statistics in the top right corner of the screen
+void DrawProfileOverlay()
+{
+    const int nX = nScreenWidth - 38;
+    char szLine[64];
+    snprintf(szLine, sizeof(szLine), "%-10s %8s %8s %8s ", "ms", "min", "avg", "p99");
+    DrawString(nX, 1, szLine);
+    for (int k = 0; k < nProfilePhases; ++k) {
+        float fMin, fAvg, fP99;
+        profiler.stats((ProfilePhase)k, &fMin, &fAvg, &fP99);
+        snprintf(szLine, sizeof(szLine), "%-10s %8.3f %8.3f %8.3f ", szPhaseNames[k], fMin*1e-3f, fAvg*1e-3f, fP99*1e-3f);
+        DrawString(nX, k + 2, szLine);
+    }
+    snprintf(szLine, sizeof(szLine), "fps %.1f over the last %d frames ", frameStats.fps(), frameStats.m_nCount);
+    DrawString(nX, nProfilePhases + 2, szLine);
+    float fAverage, fMax;
+    inputLatency.stats(&fAverage, &fMax);
+    snprintf(szLine, sizeof(szLine), "key to step %.2f ms avg, %.2f max ", fAverage*1e3f, fMax*1e3f);
+    DrawString(nX, nProfilePhases + 3, szLine);
+}
+
+
+// "00" to "99", for FormatDecimal() to write two digits at a time
+static const char szDigitPairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+
+/**
+ * Write nValue, with its last nDecimals digits after a decimal point, right-aligned in the
+ * nWidth characters at p, padded with spaces; all '*' if it does not fit.
+ */
+void FormatDecimal(wchar_t* p, int nWidth, int nValue, int nDecimals = 0)
+{
+    wchar_t szDigits[16];
+    wchar_t* const pEnd = szDigits + 16;
+    wchar_t* pFirst = pEnd;
+    unsigned int n = nValue < 0 ? 0u - (unsigned int)nValue: (unsigned int)nValue;
+    for (int k = 0; k < nDecimals; ++k, n /= 10) *--pFirst = (wchar_t)(L'0' + n % 10);
+    if (nDecimals > 0) *--pFirst = L'.';
+    // the integer part, two digits at a time
+    while (n >= 100) {
+        const char* pPair = szDigitPairs + 2*(n % 100);
+        *--pFirst = (wchar_t)pPair[1];
+        *--pFirst = (wchar_t)pPair[0];
+        n /= 100;
+    }
+    if (n >= 10) {
+        *--pFirst = (wchar_t)szDigitPairs[2*n + 1];
+        *--pFirst = (wchar_t)szDigitPairs[2*n];
+    }
+    else *--pFirst = (wchar_t)(L'0' + n);
+    if (nValue < 0) *--pFirst = L'-';
+    const int nLength = (int)(pEnd - pFirst);
+    if (nLength > nWidth) {
+        for (int k = 0; k < nWidth; ++k) p[k] = L'*';
+        return;
+    }
+    for (int k = 0; k < nWidth - nLength; ++k) p[k] = L' ';
+    memcpy(p + nWidth - nLength, pFirst, nLength*sizeof(wchar_t));
+}
+
+
+/**
+ * The HUD line: "Label: value" fields, one after the other. The cells of the line are kept
+ * from frame to frame and a field is formatted again only when its value changes, so that
+ * drawing the HUD is a copy of its cells, whatever the number of fields.
+ * 
+ * A field given a refresh period takes on the values it is set to at most that often; in
+ * between, they are ignored. That keeps quickly changing numbers, such as the frame rate,
+ * readable and cheap.
+ */
+struct Hud {
+    static const int MaxFields = 8;
+    static const int MaxLength = 160;   // cells of the whole line
+    struct Field {
+        int nStart;         // first cell of the value
+        int nWidth;         // cells of the value
+        int nDecimals;      // digits of the value after the decimal point
+        float fPeriod;      // shortest time between two changes of the value, in seconds; 0: none
+        float fWait;        // time left until the value can change
+        int nValue;         // as shown, times 10^nDecimals
+        bool bShown;        // false until the first value is set
+    };
+    Field m_fields[MaxFields];
+    int m_nFields;
+    int m_nLength;
+    WORD m_wAttributes;
+    CHAR_INFO m_cells[MaxLength];
+
+
+    Hud(WORD wAttributes = COLOUR_HUD): m_nFields(0), m_nLength(0), m_wAttributes(wAttributes) {}
+
+
+    // Add a field after the others, and return its number; its value is blank until set
+    int add(const char* szLabel, int nWidth, int nDecimals = 0, float fPeriod = 0.0f) {
+        const int nLabel = (int)strlen(szLabel);
+        const int nSeparator = m_nFields > 0 ? 3: 0;
+        assert(nDecimals >= 0 && nDecimals <= 3);
+        if (m_nFields == MaxFields || m_nLength + nSeparator + nLabel + 2 + nWidth > MaxLength)
+            throw runtime_error("no room left on the HUD for " + string(szLabel));
+        for (int k = 0; k < nSeparator; ++k) m_cells[m_nLength++] = MakeCell(L' ', m_wAttributes);
+        for (int k = 0; k < nLabel; ++k) m_cells[m_nLength++] = MakeCell((wchar_t)szLabel[k], m_wAttributes);
+        m_cells[m_nLength++] = MakeCell(L':', m_wAttributes);
+        m_cells[m_nLength++] = MakeCell(L' ', m_wAttributes);
+        Field& field = m_fields[m_nFields];
+        field = {m_nLength, nWidth, nDecimals, fPeriod, 0.0f, 0, false};
+        for (int k = 0; k < nWidth; ++k) m_cells[m_nLength++] = MakeCell(L' ', m_wAttributes);
+        return m_nFields++;
+    }
+
+
+    // Let fElapsed seconds go by for the fields that have a refresh period
+    void advance(float fElapsed) {
+        for (int k = 0; k < m_nFields; ++k)
+            if (m_fields[k].fWait > 0.0f) m_fields[k].fWait -= fElapsed;
+    }
+
+
+    void set(int nField, int nValue) {
+        Field& field = m_fields[nField];
+        if ((field.bShown && nValue == field.nValue) || field.fWait > 0.0f) return;
+        field.nValue = nValue;
+        field.bShown = true;
+        field.fWait = field.fPeriod;
+        wchar_t szValue[MaxLength];
+        FormatDecimal(szValue, field.nWidth, nValue, field.nDecimals);
+        for (int k = 0; k < field.nWidth; ++k) m_cells[field.nStart + k].Char.UnicodeChar = szValue[k];
+    }
+
+
+    void set(int nField, float fValue) {
+        float fScale = 1.0f;
+        for (int k = 0; k < m_fields[nField].nDecimals; ++k) fScale *= 10.0f;
+        set(nField, (int)lroundf(fValue*fScale));
+    }
+
+
+    // Copy the line into the screen buffer at (x, y), cutting it at the edge of the screen
+    void draw(int x, int y) const {
+        const int nLength = min(m_nLength, nScreenWidth - x);
+        if (nLength <= 0) return;
+        memcpy(screen + y*nScreenWidth + x, m_cells, nLength*sizeof(CHAR_INFO));
+        overdrawn.add(y, x, x + nLength);
+    }
+};
+
+
+// Let the aliens shoot: only the lowest living alien of each column can do it
+template <class Board>
+void UpdateAlienFiring(GameState& state)
+{
+    for (int j = 0; j < Board::gridWidth(); ++j) {
+        const int i = state.aliens.nColumnBottom[j];
+        if (i < 0) continue; // column wiped out
+        // prefer firing if right above the player; otherwise at random
+        const int nAlienX = state.nAlienBlockX + 6*j;
+        const int nPlayerX = (int)roundf(state.fPlayerX);
+        const bool bAligned = nPlayerX - nAlienGlyphWidth < nAlienX && nAlienX < nPlayerX + nAlienGlyphWidth;
+        if (state.rng.nextFloat() < (bAligned ? fAlignedFireChance : fRandomFireChance))
+            AlienFire(state, i, j);
+    }
+}
+
+
+// Apply the outcome of an effect that is over
+void EndEffect(GameState& state, const Effect& effect)
+{
+    switch (effect.type) {
+        case EFFECT_ALIEN_EXPLOSION:
+            state.aliens.remove(effect.i, effect.j); // dead
+            break;
+        case EFFECT_PLAYER_HIT:
+            state.bPlayerHit = false;
+            break;
+    }
+}
+
+
+// Start an effect lasting fDuration seconds from the current step
+void StartEffect(GameState& state, EffectType type, float fDuration, int i, int j)
+{
+    const Effect effect = { state.nStep + (unsigned)(fDuration / fTimeStep + 0.5f), type, i, j };
+    Effect evicted;
+    if (state.effects.push(effect, &evicted)) EndEffect(state, evicted);
+}
+
+
+/**
+ * Advance the game by one fixed time step, `fTimeStep` seconds long.
+ * \param nInput keys held during the step; bit k is set IFF key k of `KeyMnemonics` is pressed.
+ * 
+ * The outcome depends only on the input and on `state`, its random numbers included: given
+ * the same state and the same sequence of inputs, a game plays out in exactly the same way.
+ * Nothing outside of `state` is changed, so games on different threads do not interfere.
+ */
+template <class Board>
+void Step(GameState& state, unsigned char nInput)
+{
+    const float fElapsedTime = fTimeStep;
+    int iAlien = -1, jAlien = -1;
+    state.nStep ++;
+    for (int k = 0; k < nPlayerKeys; ++k)
+        state.bKeyPressed[k] = (nInput & (1 << k)) != 0;
+    state.fAnimElapsed += fElapsedTime;
+    bool bUpdateAnim = state.fAnimElapsed >= state.fAnimDelay; // true IFF it is time to move the aliens
+
+    if (state.bKeyPressed[LEFT_ARROW] && ! state.bPlayerHit) {
+        float dx = state.fPlayerVx * fElapsedTime;
+        if (state.fPlayerX > dx) state.fPlayerX -= dx;
+        else state.fPlayerX = 0.0f;
+    }
+    else state.bKeyHold[LEFT_ARROW] = true;
+
+    if (state.bKeyPressed[RIGHT_ARROW] && ! state.bPlayerHit) {
+        float dx = state.fPlayerVx * fElapsedTime;
+        const float maxX = (float)(Board::width() - nPlayerWidth);
+        if (state.fPlayerX + dx <= maxX) state.fPlayerX += dx;
+        else state.fPlayerX = maxX;
+    }
+    else state.bKeyHold[RIGHT_ARROW] = true;
+
+    // Firing
+    if (state.bullet.visible) { // already fired; move bullet
+        const int nPrevY = (int)roundf(state.bullet.y);
+        state.bullet.y += state.fPlayerBulletSpeed * fElapsedTime;
+        ProfileScope scope(PHASE_COLLISION);
+        int nBulletX = (int)roundf(state.bullet.x);
+        int nBulletY = (int)roundf(state.bullet.y);
+        // check every row entered during the step (or the current one, if the bullet is still in
+        // the same row): however fast it goes, it cannot jump over a shield or an alien
+        for (int y = (nBulletY < nPrevY) ? nPrevY - 1: nBulletY; y >= nBulletY && state.bullet.visible; --y) {
+            // check if the shields are hit
+            if (state.obstacles.hit(nBulletX, y))
+                state.bullet.visible = false;
+            else if (y <= 0)
+                state.bullet.visible = false;
+            else if (HitAlien<Board>(state, nBulletX, y, &iAlien, &jAlien)) {
+                state.bullet.visible = false;
+                state.aliens.kill(iAlien, jAlien);
+                StartEffect(state, EFFECT_ALIEN_EXPLOSION, fAlienExplosionTime, iAlien, jAlien);
+                state.nScore += 100;
+            }
+        }
+    }
+    else if (state.bKeyPressed[SPACEBAR] && state.bKeyHold[SPACEBAR]  && ! state.bPlayerHit) { // firing new bullet?
+        state.bullet.y = (float)Board::height() - 2.0f;
+        state.bullet.x = state.fPlayerX + 1.0f;
+        state.bullet.visible = true;
+        state.bKeyHold[SPACEBAR] = false;
+    }
+    else { // spacebar released
+        state.bKeyHold[SPACEBAR] = true;
+    }
+
+    //// Update Logic
+    // Move the aliens; the edges of the formation are those of the living aliens
+    if (state.aliens.nAlive == 0) {
+        // wiped out: hold still until the last explosions are over
+    }
+    else if (state.nAlienBlockY + 2*state.aliens.nBottomRow >= state.nPlayerY) {
+        // Aliens at the bottom of the screen
+        state.bGameOver = true;
+        state.nAlienBlockY = 2;
+    }
+    else if (bUpdateAnim && (state.nAlienBlockX + 6*state.aliens.nRightColumn + 2*nAlienGlyphWidth >= Board::width())) {
+        // reached the right side of the screen
+        state.nAlienStep = (state.nAlienStep == 1) ? -1: 1;
+        state.nAlienBlockY ++;
+        state.nAlienBlockX --;
+        state.fAnimDelay = max(state.fAnimDelay - 0.05f, fMinAnimDelay);
+    }
+    else if (bUpdateAnim && (state.nAlienBlockX + 6*state.aliens.nLeftColumn <= 0)) {
+        // reached the left side of the screen
+        state.nAlienStep = (state.nAlienStep == 1) ? -1: 1;
+        state.nAlienBlockY ++;
+        state.nAlienBlockX ++;
+        state.fAnimDelay = max(state.fAnimDelay - 0.05f, fMinAnimDelay);
+    }
+    else {
+        // move state.aliens by one lateral step, if it is time to do it
+        state.nAlienBlockX += bUpdateAnim ? state.nAlienStep: 0;
+    }
+    UpdateAlienFiring<Board>(state);
+    // update alien bullets: move them all, then see what they hit
+    state.alienBullets.move(fElapsedTime);
+    {
+        ProfileScope scope(PHASE_COLLISION);
+        const int nPlayerX = (int)roundf(state.fPlayerX);
+        // first, all at once, sort out the bullets that are only falling through empty rows
+        int nRows[BulletPool::MaxCapacity];
+        unsigned char bCheck[BulletPool::MaxCapacity];
+        simd.pfnClassifyBullets(state.alienBullets.y, state.alienBullets.row, state.alienBullets.nLive,
+            state.obstacles.nTop, state.obstacles.nTop + ObstacleGrid::Rows - 1, Board::height(), nRows, bCheck);
+        // backwards, so that release() only moves in bullets that have been dealt with already
+        for (int k = state.alienBullets.nLive - 1; k >= 0; --k) {
+            const int nY = nRows[k];
+            if ( ! bCheck[k]) {
+                state.alienBullets.row[k] = nY;
+                continue;
+            }
+            int nX = (int)roundf(state.alienBullets.x[k]);
+            bool bGone = false;
+            // check every row entered since the last step, as for the player's bullet
+            for (int y = (nY > state.alienBullets.row[k]) ? state.alienBullets.row[k] + 1: nY; y <= nY && ! bGone; ++y) {
+                // check if a shield has been hit
+                if (state.obstacles.hit(nX, y)) bGone = true;
+                else if ( ! state.bPlayerHit && y == Board::height() && nPlayerX <= nX && nX < (nPlayerX+3) ) {
+                    // player has been hit
+                    state.bPlayerHit = true;
+                    StartEffect(state, EFFECT_PLAYER_HIT, fPlayerHitTime, 0, 0);
+                    state.nLives -= (state.nLives > 0) ? 1: 0;
+                    state.bGameOver = state.nLives == 0;
+                    bGone = true;
+                }
+                else if ( y >= Board::height() ) bGone = true;
+            }
+            if (bGone) state.alienBullets.release(k);
+            else state.alienBullets.row[k] = nY;
+        }
+    }
+    // animate the explosions
+    state.effects.expire(state.nStep, [&state](const Effect& effect) { EndEffect(state, effect); });
+    // formation wiped out: once the last explosion is over, the next wave comes in from the top
+    if (state.aliens.nAlive == 0 && state.aliens.nExploding == 0) {
+        state.aliens.revive();
+        state.nAlienBlockX = 2;
+        state.nAlienBlockY = 2;
+        state.nAlienStep = 1;
+    }
+    if (bUpdateAnim) {
+        state.nFrameOffset = state.nFrameOffset == 3 ? 0 : 3;
+        state.fAnimElapsed = 0.0f;
+    }
+}
+
+
+/**
+ * Builds the frames in layers, so that what a frame costs follows what moves on it rather
+ * than the size of the board.
+ * 
+ * The shields are drawn over blanks into the background, the aliens over the background
+ * into the scene, and the screen buffer is the scene with the moving sprites (player and
+ * bullets) and the text on top. The still layers keep a copy of what they were drawn from,
+ * and are drawn again only when it changes: the background when a shield is hit, the scene
+ * when the formation moves, animates, or loses an alien. Every frame, the cells the moving
+ * sprites and the text took on the frame before (see `overdrawn`) are put back from the
+ * scene, as are the cells of the scene that changed, before the sprites are drawn again.
+ */
+struct Compositor {
+    vector<CHAR_INFO> m_background;     // blanks and shields
+    vector<CHAR_INFO> m_scene;          // the background with the aliens on top
+    DirtySpans m_stale;                 // cells of the scene to draw again for this frame
+    bool m_bValid;                      // false until the layers are drawn for the first time
+    // what the layers were drawn from
+    unsigned char m_strength[ObstacleGrid::Rows*ObstacleGrid::MaxWidth];
+    int m_nAlienBlockX;
+    int m_nAlienBlockY;
+    int m_nFrameOffset;
+    uint64_t m_alive[AlienGrid::MaxRows*AlienGrid::MaxWordsPerRow];
+    uint64_t m_exploding[AlienGrid::MaxRows*AlienGrid::MaxWordsPerRow];
+
+
+    Compositor(): m_bValid(false) {}
+
+
+    // Size the layers after the board set by ConfigureBoard(); they are drawn anew on the next frame
+    void configure() {
+        m_background.resize(nScreenWidth*nScreenHeight);
+        m_scene.resize(nScreenWidth*nScreenHeight);
+        m_stale.resize(nScreenHeight);
+        overdrawn.resize(nScreenHeight);
+        m_bValid = false;
+    }
+
+
+    // The cells of the formation with its top left alien at (nBlockX, nBlockY) are stale
+    template <class Board>
+    void staleFormation(int nBlockX, int nBlockY) {
+        for (int i = 0; i < Board::gridHeight(); ++i)
+            m_stale.add(nBlockY + 2*i, nBlockX, nBlockX + 6*(Board::gridWidth() - 1) + nAlienGlyphWidth);
+    }
+
+
+    // Draw the game (everything but the HUD line) into the screen buffer
+    template <class Board>
+    void compose(const GameState& state) {
+        const int nCells = Board::width()*Board::height();
+        // sized at run time on every board: with a size known at compile time, GCC copies the
+        // strengths with an inline `rep movsq`, which takes longer to start than the copy itself
+        const int nStrengthBytes = ObstacleGrid::Rows*nScreenWidth;
+        const int nAlienBytes = Board::wordsPerRow()*Board::gridHeight()*sizeof(uint64_t);
+        const AlienGrid& aliens = state.aliens;
+        // the moving sprites and the text of the frame before make way
+        overdrawn.copy(m_scene.data(), screen);
+        overdrawn.clear();
+        if ( ! m_bValid) {
+            simd.pfnFill(m_background.data(), nCells, MakeCell(L' ', COLOUR_TEXT));
+            DrawShields<Board>(state, m_background.data());
+            memcpy(m_scene.data(), m_background.data(), nCells*sizeof(CHAR_INFO));
+            DrawAliens<Board>(state, m_scene.data());
+            memcpy(screen, m_scene.data(), nCells*sizeof(CHAR_INFO));
+            m_bValid = true;
+        }
+        else {
+            const bool bShields = memcmp(m_strength, state.obstacles.m_strength, nStrengthBytes) != 0;
+            const bool bAliens = m_nAlienBlockX != state.nAlienBlockX || m_nAlienBlockY != state.nAlienBlockY ||
+                m_nFrameOffset != state.nFrameOffset || memcmp(m_alive, aliens.m_alive, nAlienBytes) != 0 ||
+                memcmp(m_exploding, aliens.m_exploding, nAlienBytes) != 0;
+            if (bShields) {
+                DrawShields<Board>(state, m_background.data());
+                for (int i = 0; i < ObstacleGrid::Rows; ++i) m_stale.add(state.obstacles.nTop + i, 0, Board::width());
+            }
+            // the formation leaves where it was, and takes its new place
+            if (bAliens) {
+                staleFormation<Board>(m_nAlienBlockX, m_nAlienBlockY);
+                staleFormation<Board>(state.nAlienBlockX, state.nAlienBlockY);
+            }
+            // the aliens over the stale cells are lost with them: all are drawn again, as they cost little
+            if (bShields || bAliens) {
+                m_stale.copy(m_background.data(), m_scene.data());
+                DrawAliens<Board>(state, m_scene.data());
+                m_stale.copy(m_scene.data(), screen);
+                m_stale.clear();
+            }
+        }
+        memcpy(m_strength, state.obstacles.m_strength, nStrengthBytes);
+        m_nAlienBlockX = state.nAlienBlockX;
+        m_nAlienBlockY = state.nAlienBlockY;
+        m_nFrameOffset = state.nFrameOffset;
+        memcpy(m_alive, aliens.m_alive, nAlienBytes);
+        memcpy(m_exploding, aliens.m_exploding, nAlienBytes);
+        DrawPlayer(state);
+        DrawBullets<Board>(state.alienBullets, &state.bullet);
+    }
+};
+
+Compositor compositor;
+
+
+// Draw the game (everything but the HUD line) into the screen buffer, see Compositor
+template <class Board>
+void DrawGame(const GameState& state)
+{
+    compositor.compose<Board>(state);
+}
+
+
+// The kernels of a step and of a frame, compiled for the board set by ConfigureBoard()
+struct BoardKernels {
+    void (*pfnStep)(GameState&, unsigned char);
+    void (*pfnDrawGame)(const GameState&);
+
+
+    template <class Board>
+    static BoardKernels of() { return { Step<Board>, DrawGame<Board> }; }
+};
+
+BoardKernels boardKernels = BoardKernels::of<RuntimeBoard>();
+
+
+// Advance the game by one step, see Step<Board>()
+inline void Step(GameState& state, unsigned char nInput) { boardKernels.pfnStep(state, nInput); }
+
+
+// Draw the game with the kernels of the board, see DrawGame<Board>()
+inline void DrawGame(const GameState& state) { boardKernels.pfnDrawGame(state); }
+
+
+// Smallest board that fits the HUD, the profiling overlay and the shields
+static const int nMinScreenWidth = 60;
+static const int nMinScreenHeight = 16;
+
+// Smallest board that fits a formation of nGridWidth x nGridHeight aliens: it starts at (2, 2)
+// and must have room to move sideways and above the shields
+inline int FormationMinWidth(int nGridWidth) { return 3 + 6*nGridWidth; }
+inline int FormationMinHeight(int nGridHeight) { return 10 + 2*nGridHeight; }
+
+
+/**
+ * Set the size of the board and of the alien formation, and how many alien bullets can be
+ * in flight at the same time; allocate the screen buffer sized after them. Called once at
+ * startup, before InitGame(): the frame loop never allocates.
+ */
+void ConfigureBoard(int nWidth, int nHeight, int nGridWidth, int nGridHeight, int nBullets)
+{
+    if (nGridWidth < 1 || nGridHeight < 1 || nGridWidth > AlienGrid::MaxColumns || nGridHeight > AlienGrid::MaxRows)
+        throw runtime_error("the grid can be from 1x1 to " + to_string(AlienGrid::MaxColumns) + "x" +
+            to_string(AlienGrid::MaxRows) + " aliens");
+    // the formation may need more room than the HUD: the default one of 10x4 aliens takes 63x18
+    const int nMinWidth = max(nMinScreenWidth, FormationMinWidth(nGridWidth));
+    const int nMinHeight = max(nMinScreenHeight, FormationMinHeight(nGridHeight));
+    if (nWidth < nMinWidth || nHeight < nMinHeight)
+        throw runtime_error("the board must be at least " + to_string(nMinWidth) + "x" + to_string(nMinHeight) + " for a grid of " +
+            to_string(nGridWidth) + "x" + to_string(nGridHeight) + " aliens");
+    if (nWidth > ObstacleGrid::MaxWidth)
+        throw runtime_error("the board can be at most " + to_string(ObstacleGrid::MaxWidth) + " columns wide");
+    if (nHeight > SHRT_MAX)
+        throw runtime_error("the board can be at most " + to_string(SHRT_MAX) + " rows high");
+    if (nBullets < 1 || nBullets > BulletPool::MaxCapacity)
+        throw runtime_error("between 1 and " + to_string(BulletPool::MaxCapacity) + " alien bullets can be in flight");
+    nScreenWidth = nWidth;
+    nScreenHeight = nHeight;
+    nAlienBlockWidth = nGridWidth;
+    nAlienBlockHeight = nGridHeight;
+    nMaxAlienBullets = nBullets;
+    boardKernels = StandardBoard::configured() ? BoardKernels::of<StandardBoard>(): BoardKernels::of<RuntimeBoard>();
+    delete[] screen;
+    screen = new CHAR_INFO[nScreenWidth*nScreenHeight];
+    compositor.configure();
+}
+
+
+// Fingerprint of the state of the game, to check that replays play out the same way
+uint32_t HashGameState(const GameState& state)
+{
+    uint32_t h = 2166136261u; // FNV-1a
+    auto mix = [&h](const void* pData, size_t nBytes) {
+        const unsigned char* p = (const unsigned char*)pData;
+        for (size_t k = 0; k < nBytes; ++k) h = (h ^ p[k]) * 16777619u;
+    };
+    mix(&state.nScore, sizeof(state.nScore));
+    mix(&state.nLives, sizeof(state.nLives));
+    mix(&state.fPlayerX, sizeof(state.fPlayerX));
+    mix(&state.nAlienBlockX, sizeof(state.nAlienBlockX));
+    mix(&state.nAlienBlockY, sizeof(state.nAlienBlockY));
+    mix(state.aliens.m_alive, state.aliens.nWordsPerRow*nAlienBlockHeight*sizeof(uint64_t));
+    mix(state.obstacles.m_strength, ObstacleGrid::Rows*nScreenWidth);
+    mix(&state.bullet.visible, sizeof(state.bullet.visible));
+    mix(&state.bullet.y, sizeof(state.bullet.y));
+    mix(&state.alienBullets.nLive, sizeof(state.alienBullets.nLive));
+    mix(state.alienBullets.x, state.alienBullets.nLive*sizeof(float));
+    mix(state.alienBullets.y, state.alienBullets.nLive*sizeof(float));
+    return h;
+}
+
+
+/**
+ * Find the cells of pFrame that differ from pLastFrame, the frame shown before, and hand
+ * them to emit(y, nStart, nEnd) one run of cells [nStart, nEnd) on row y at a time; the
+ * runs are copied to pLastFrame on the way. Runs on the same row separated by fewer than
+ * `MergeGap` unchanged cells are merged, because every write to the terminal has a fixed
+ * cost that outweighs a few extra cells. Returns the number of cells emitted.
+ */
+static const int MergeGap = 4;
+
+template <typename F>
+int ForEachChangedRun(const CHAR_INFO* pFrame, CHAR_INFO* pLastFrame, F emit)
+{
+    int nCells = 0;
+    for (int y = 0; y < nScreenHeight; ++y) {
+        const CHAR_INFO* pRow = &pFrame[y*nScreenWidth];
+        CHAR_INFO* pLastRow = &pLastFrame[y*nScreenWidth];
+        int x = 0;
+        while (x < nScreenWidth) {
+            // skip to the start of the next changed run
+            while (x < nScreenWidth && SameCell(pRow[x], pLastRow[x])) ++x;
+            if (x == nScreenWidth) break;
+            int nStart = x, nEnd = x + 1, nGap = 0;
+            // extend the run, swallowing short gaps of unchanged cells
+            for (++x; x < nScreenWidth; ++x) {
+                if (! SameCell(pRow[x], pLastRow[x])) { nEnd = x + 1; nGap = 0; }
+                else if (++nGap > MergeGap) break;
+            }
+            emit(y, nStart, nEnd);
+            memcpy(&pLastRow[nStart], &pRow[nStart], (nEnd - nStart)*sizeof(CHAR_INFO));
+            nCells += nEnd - nStart;
+            x = nEnd;
+        }
+    }
+    return nCells;
+}
+
+
+// The keys a terminal reports: those of the player (see KeyMnemonics), then the others
+enum TerminalKeys {
+    OVERLAY_KEY = nPlayerKeys,  // F3
+    nTerminalKeys
+};
+
+
+struct KeyEvent {
+    chrono::steady_clock::time_point time;  // when the key went down or up
+    unsigned char nKey;
+    bool bDown;
+};
+
+
+/**
+ * A queue of bounded capacity, without locks, between one producer thread and one consumer
+ * thread. Each side only writes its own index, which other side reads; the release stores
+ * and acquire loads make the items visible before the index that covers them.
+ */
+template <typename T, unsigned Capacity>
+struct SpscQueue {
+    static_assert((Capacity & (Capacity - 1)) == 0, "the capacity must be a power of 2");
+    T m_items[Capacity];
+    atomic<unsigned> m_nHead;   // next item to pop, written by the consumer
+    atomic<unsigned> m_nTail;   // next free slot, written by the producer
+
+
+    SpscQueue(): m_nHead(0), m_nTail(0) {}
+
+
+    // Producer side; false if the queue is full
+    bool push(const T& item) {
+        const unsigned nTail = m_nTail.load(memory_order_relaxed);
+        if (nTail - m_nHead.load(memory_order_acquire) == Capacity) return false;
+        m_items[nTail % Capacity] = item;
+        m_nTail.store(nTail + 1, memory_order_release);
+        return true;
+    }
+
+
+    // Consumer side; false if the queue is empty
+    bool pop(T* pItem) {
+        const unsigned nHead = m_nHead.load(memory_order_relaxed);
+        if (nHead == m_nTail.load(memory_order_acquire)) return false;
+        *pItem = m_items[nHead % Capacity];
+        m_nHead.store(nHead + 1, memory_order_release);
+        return true;
+    }
+
+
+    bool empty() const { return m_nHead.load(memory_order_acquire) == m_nTail.load(memory_order_acquire); }
+};
+
+
+/**
+ * The key events read by the input thread, on their way to the simulation. Posting and
+ * popping never lock; a consumer with nothing else to do can sleep in wait() until the
+ * next event, the producer rings it after every post.
+ */
+struct InputQueue {
+    SpscQueue<KeyEvent, 256> m_events;
+    mutex m_mutex;
+    condition_variable m_posted;
+
+
+    // Input thread: queue an event; dropped if the consumer is that far behind
+    void post(unsigned char nKey, bool bDown) {
+        m_events.push({chrono::steady_clock::now(), nKey, bDown});
+        { lock_guard<mutex> lock(m_mutex); }
+        m_posted.notify_one();
+    }
+
+
+    bool pop(KeyEvent* pEvent) { return m_events.pop(pEvent); }
+
+
+    // Block until there is an event to pop
+    void wait() {
+        unique_lock<mutex> lock(m_mutex);
+        m_posted.wait(lock, [this]() { return ! m_events.empty(); });
+    }
+};
+
+
+/**
+ * What the game needs from the terminal it is played on: show frames and report the keys
+ * going down and up. Only the differences between frames are sent, see `ForEachChangedRun`.
+ */
+struct TerminalBackend {
+    int nCellsWritten; // cells sent to the terminal by the last call to present()
+
+
+    TerminalBackend(): nCellsWritten(0) {}
+    virtual ~TerminalBackend() {}
+    // Size of the window, in cells; false if it cannot be told
+    virtual bool windowSize(int* pWidth, int* pHeight) = 0;
+    // Take over the terminal, for a board of the current size
+    virtual void open() = 0;
+    // Give the terminal back the way it was found; nothing can be presented afterwards
+    virtual void close() = 0;
+    // Forget what is on show, so that the next frame is written in full
+    virtual void invalidate() = 0;
+    virtual int present(const CHAR_INFO* pFrame) = 0;
+    // Read the keyboard into the queue until bStop is set; runs on a thread of its own
+    virtual void readInput(InputQueue& input, const atomic<bool>& bStop) = 0;
+};
+
+
+#if defined(_WIN32)
+/**
+ * The Win32 console.
+ * 
+ * Two console screen buffers take turns: a frame is written into the one that is hidden,
+ * which is then made the active one with `SetConsoleActiveScreenBuffer`, so the console
+ * never shows a frame halfway through being written.
+ * 
+ * A copy of the frame last written to each buffer is kept, and the frame is compared
+ * against the copy of the buffer about to be written; each run of changed cells, glyphs
+ * and colours together, is written with one `WriteConsoleOutput` call.
+ */
+struct Win32Console: TerminalBackend {
+    static const int nPages = 2;
+    HANDLE m_hPages[nPages];
+    CHAR_INFO *m_lastFrames[nPages];
+    int m_nBackPage;   // the buffer that is not on show, where the next frame goes
+
+
+    Win32Console(): m_nBackPage(0) {
+        for (int k = 0; k < nPages; ++k) {
+            m_hPages[k] = NULL;
+            m_lastFrames[k] = NULL;
+        }
+    }
+
+
+    ~Win32Console() { close(); }
+
+
+    bool windowSize(int* pWidth, int* pHeight) override {
+        CONSOLE_SCREEN_BUFFER_INFO csbi;
+        if (! GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &csbi)) return false;
+        *pWidth = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+        *pHeight = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+        return true;
+    }
+
+
+    void open() override {
+        for (int k = 0; k < nPages; ++k) {
+            m_hPages[k] = CreateConsoleScreenBuffer(GENERIC_READ | GENERIC_WRITE, 0, NULL, CONSOLE_TEXTMODE_BUFFER, NULL);
+            if (m_hPages[k] == INVALID_HANDLE_VALUE) {
+                m_hPages[k] = NULL;
+                close();
+                throw runtime_error("cannot create a console screen buffer");
+            }
+            // a board larger than the window scrolls; this fails, harmlessly, for one smaller than the window
+            SetConsoleScreenBufferSize(m_hPages[k], { (SHORT)nScreenWidth, (SHORT)nScreenHeight });
+            m_lastFrames[k] = new CHAR_INFO[nScreenWidth*nScreenHeight];
+        }
+        invalidate();
+    }
+
+
+    void close() override {
+        if (m_hPages[0] != NULL) SetConsoleActiveScreenBuffer(GetStdHandle(STD_OUTPUT_HANDLE));
+        for (int k = 0; k < nPages; ++k) {
+            if (m_hPages[k] != NULL) CloseHandle(m_hPages[k]);
+            m_hPages[k] = NULL;
+            delete[] m_lastFrames[k];
+            m_lastFrames[k] = NULL;
+        }
+    }
+
+
+    void invalidate() override {
+        for (int k = 0; k < nPages; ++k)
+            for (int i = 0; i < nScreenWidth*nScreenHeight; ++i) m_lastFrames[k][i] = MakeCell(L'\0', 0);
+    }
+
+
+    // Write the frame into the hidden buffer and show it
+    int present(const CHAR_INFO* pFrame) override {
+        const COORD frameSize = { (SHORT)nScreenWidth, (SHORT)nScreenHeight };
+        const HANDLE hConsole = m_hPages[m_nBackPage];
+        nCellsWritten = ForEachChangedRun(pFrame, m_lastFrames[m_nBackPage], [&](int y, int nStart, int nEnd) {
+            // the run is read straight out of the frame: the console takes the whole buffer and a region of it
+            SMALL_RECT region = { (SHORT)nStart, (SHORT)y, (SHORT)(nEnd - 1), (SHORT)y };
+            WriteConsoleOutput(hConsole, pFrame, frameSize, { (SHORT)nStart, (SHORT)y }, &region);
+        });
+        // the flip: the frame appears all at once, and the other buffer is free for the next one
+        SetConsoleActiveScreenBuffer(hConsole);
+        m_nBackPage = (m_nBackPage + 1) % nPages;
+        return nCellsWritten;
+    }
+
+
+    // Key events come with their state, and repeat while a key is held: only the changes are posted
+    void readInput(InputQueue& input, const atomic<bool>& bStop) override {
+        static const WORD virtualKeys[nTerminalKeys] = {VK_LEFT, VK_RIGHT, VK_SPACE, VK_ESCAPE, VK_PAUSE, VK_F3};
+        const HANDLE hInput = GetStdHandle(STD_INPUT_HANDLE);
+        bool bDown[nTerminalKeys] = {};
+        while (! bStop) {
+            // wake up now and then to check whether to stop
+            if (WaitForSingleObject(hInput, 50) != WAIT_OBJECT_0) continue;
+            INPUT_RECORD records[32];
+            DWORD nRecords = 0;
+            if (! ReadConsoleInputW(hInput, records, 32, &nRecords)) break;
+            for (DWORD r = 0; r < nRecords; ++r) {
+                if (records[r].EventType != KEY_EVENT) continue;
+                const KEY_EVENT_RECORD& key = records[r].Event.KeyEvent;
+                for (int k = 0; k < nTerminalKeys; ++k)
+                    if (key.wVirtualKeyCode == virtualKeys[k] && bDown[k] != (key.bKeyDown != FALSE)) {
+                        bDown[k] = key.bKeyDown != FALSE;
+                        input.post((unsigned char)k, bDown[k]);
+                    }
+            }
+        }
+    }
+};
+
+
+#else
+// The terminal settings to restore on exit, also from the signal handlers
+static struct termios savedTermios;
+static bool bTermiosSaved = false;
+// Undo what VtTerminal::open() did to the screen: colours, cursor, wrapping, alternate screen
+static const char szVtRestore[] = "\x1b[0m\x1b[?25h\x1b[?7h\x1b[?1049l";
+
+
+// Put the terminal back in order if the game is interrupted or aborts, then die from the same signal
+extern "C" void RestoreTerminalOnSignal(int nSignal)
+{
+    if (bTermiosSaved) tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedTermios);
+    ssize_t nIgnored = write(STDOUT_FILENO, szVtRestore, sizeof(szVtRestore) - 1);
+    // the error went to the alternate screen, gone with it
+    if (szFatalError[0] != '\0') nIgnored = write(STDERR_FILENO, szFatalError, strlen(szFatalError));
+    (void)nIgnored;
+    signal(nSignal, SIG_DFL);
+    raise(nSignal);
+}
+
+
+/**
+ * A terminal driven with ANSI/VT escape sequences, such as any terminal emulator on Linux
+ * or macOS, also over SSH.
+ * 
+ * The whole frame goes out with one `write()`: the changed runs only, each preceded by the
+ * shortest cursor move that reaches it and by a change of colour when needed, and wrapped
+ * in a synchronized update so that terminals supporting it show the frame all at once.
+ * 
+ * The keyboard is read in raw mode. A terminal only reports key presses, and repeats
+ * them while a key is held, so a key is taken as held from the moment it is seen until
+ * shortly after it stops repeating.
+ */
+struct VtTerminal: TerminalBackend {
+    // How long a key is held after being seen: long enough, the first time, to get to the
+    // first auto-repeat, and for a little longer than the period of repeat afterwards
+    static constexpr double fFirstHoldTime = 0.55;
+    static constexpr double fRepeatHoldTime = 0.1;
+    // The start of an escape sequence is kept for this long, in milliseconds, for the rest of
+    // it to come, as long as it is no longer than the longest sequence read
+    static constexpr int EscapeTimeout = 50;
+    static constexpr int MaxEscapeLength = 16;
+    // Longest output for a cell: a cursor move, a change of colours and a UTF-8 character
+    static const int MaxBytesPerCell = 32;
+    vector<CHAR_INFO> m_lastFrame;
+    FrameArena m_arena;
+    char* m_pOutput;    // the escape sequences and text of the frame being presented, taken from m_arena
+    size_t m_nOutput;
+    int m_nCursorX;     // where the cursor is, -1 if unknown
+    int m_nCursorY;
+    WORD m_wAttributes; // current colour, 0xFFFF if unknown
+    bool m_bOpen;
+
+
+    VtTerminal(): m_pOutput(NULL), m_nOutput(0), m_nCursorX(-1), m_nCursorY(-1), m_wAttributes(0xFFFF), m_bOpen(false) {}
+
+
+    ~VtTerminal() { close(); }
+
+
+    bool windowSize(int* pWidth, int* pHeight) override {
+        struct winsize ws;
+        if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_col == 0 || ws.ws_row == 0) return false;
+        *pWidth = ws.ws_col;
+        *pHeight = ws.ws_row;
+        return true;
+    }
+
+
+    void open() override {
+        if (! isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &savedTermios) != 0)
+            throw runtime_error("the standard input is not a terminal");
+        bTermiosSaved = true;
+        signal(SIGINT, RestoreTerminalOnSignal);
+        signal(SIGTERM, RestoreTerminalOnSignal);
+        signal(SIGHUP, RestoreTerminalOnSignal);
+        signal(SIGABRT, RestoreTerminalOnSignal);
+        // raw input, bar the signals, and reads that never block
+        struct termios raw = savedTermios;
+        raw.c_iflag &= ~(IXON | ICRNL | INLCR | ISTRIP);
+        raw.c_lflag &= ~(ICANON | ECHO | IEXTEN);
+        raw.c_cc[VMIN] = 0;
+        raw.c_cc[VTIME] = 0;
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        // alternate screen, no cursor, no wrapping at the right edge
+        static const char szSetup[] = "\x1b[?1049h\x1b[?25l\x1b[?7l\x1b[2J";
+        send(szSetup, sizeof(szSetup) - 1);
+        m_lastFrame.resize(nScreenWidth*nScreenHeight);
+        m_arena.reserve(maxFrameBytes());
+        m_bOpen = true;
+        invalidate();
+    }
+
+
+    void close() override {
+        if (! m_bOpen) return;
+        m_bOpen = false;
+        send(szVtRestore, sizeof(szVtRestore) - 1);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &savedTermios);
+        bTermiosSaved = false;
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        signal(SIGHUP, SIG_DFL);
+        signal(SIGABRT, SIG_DFL);
+    }
+
+
+    void invalidate() override {
+        for (auto& cell: m_lastFrame) cell = MakeCell(L'\0', 0);
+        m_nCursorX = m_nCursorY = -1;
+        m_wAttributes = 0xFFFF;
+    }
+
+
+    int present(const CHAR_INFO* pFrame) override {
+        m_arena.reset();
+        m_pOutput = m_arena.allocate<char>(maxFrameBytes());
+        m_nOutput = 0;
+        append("\x1b[?2026h");
+        nCellsWritten = ForEachChangedRun(pFrame, m_lastFrame.data(), [&](int y, int nStart, int nEnd) {
+            moveCursor(nStart, y);
+            for (int x = nStart; x < nEnd; ++x) {
+                const CHAR_INFO& cell = pFrame[y*nScreenWidth + x];
+                if (cell.Attributes != m_wAttributes) setColour(cell.Attributes);
+                appendUtf8(cell.Char.UnicodeChar);
+            }
+            // past the last column the cursor waits to wrap, and where it goes next depends on the terminal
+            m_nCursorX = nEnd < nScreenWidth ? nEnd: -1;
+        });
+        append("\x1b[?2026l");
+        if (nCellsWritten > 0) send(m_pOutput, m_nOutput);
+        return nCellsWritten;
+    }
+
+
+    // Terminals report the presses only, so the releases are made up from the hold times
+    void readInput(InputQueue& input, const atomic<bool>& bStop) override {
+        const auto noKey = chrono::steady_clock::time_point::max();
+        chrono::steady_clock::time_point released[nTerminalKeys];   // when the keys held are let go
+        for (auto& time: released) time = noKey;
+        auto press = [&](int nKey, chrono::steady_clock::time_point now) {
+            // seen again while held: the key repeats
+            const bool bRepeating = released[nKey] != noKey;
+            if (! bRepeating) input.post((unsigned char)nKey, true);
+            released[nKey] = now + chrono::duration_cast<chrono::steady_clock::duration>(
+                chrono::duration<double>(bRepeating ? fRepeatHoldTime: fFirstHoldTime));
+        };
+        // the start of an escape sequence cut by the end of a read, finished by the next one
+        char buffer[MaxEscapeLength + 256];
+        ssize_t nPending = 0;
+        chrono::steady_clock::time_point escapeDeadline;  // a lone ESC is the Esc key if nothing follows by then
+        while (! bStop) {
+            // sleep until there is input, a key to let go, a lone ESC to settle, or it is time to check whether to stop
+            auto now = chrono::steady_clock::now();
+            auto wakeUp = now + chrono::milliseconds(50);
+            for (auto& time: released) wakeUp = min(wakeUp, time);
+            if (nPending > 0) wakeUp = min(wakeUp, escapeDeadline);
+            struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+            const int nTimeout = (int)chrono::duration_cast<chrono::milliseconds>(wakeUp - now).count();
+            if (::poll(&fd, 1, max(nTimeout, 0)) > 0 && (fd.revents & POLLIN)) {
+                const ssize_t nRead = read(STDIN_FILENO, buffer + nPending, sizeof(buffer) - nPending);
+                const ssize_t nBytes = nPending + max(nRead, (ssize_t)0);
+                nPending = 0;
+                now = chrono::steady_clock::now();
+                for (ssize_t k = 0; k < nBytes; ++k) {
+                    int nKey = -1;
+                    if (buffer[k] != '\x1b') {
+                        if (buffer[k] == ' ') nKey = SPACEBAR;
+                        else if (buffer[k] == 'p' || buffer[k] == 'P') nKey = PAUSE;
+                        else if (buffer[k] == 'q' || buffer[k] == 'Q') nKey = ESC;
+                    }
+                    // an escape sequence: arrows are ESC [ C/D (or ESC O C/D), F3 is ESC O R or ESC [ 1 3 ~;
+                    // an ESC followed by anything else is the Esc key
+                    else if (k + 1 == nBytes || buffer[k+1] == '[' || buffer[k+1] == 'O') {
+                        ssize_t nEnd = k + 2;
+                        while (nEnd < nBytes && (unsigned char)(buffer[nEnd] - 0x30) < 0x10) ++nEnd;  // parameters
+                        if (nEnd >= nBytes) {
+                            // cut short: kept for the next read, unless too long to be one we know
+                            if (nBytes - k <= MaxEscapeLength) {
+                                memmove(buffer, buffer + k, nBytes - k);
+                                nPending = nBytes - k;
+                                escapeDeadline = now + chrono::milliseconds(EscapeTimeout);
+                            }
+                            break;
+                        }
+                        const char* pSequence = buffer + k + 1;
+                        const size_t nLength = nEnd - k;
+                        auto is = [pSequence, nLength](const char* sz) { return strlen(sz) == nLength && memcmp(pSequence, sz, nLength) == 0; };
+                        if (is("[D") || is("OD")) nKey = LEFT_ARROW;
+                        else if (is("[C") || is("OC")) nKey = RIGHT_ARROW;
+                        else if (is("OR") || is("[13~")) nKey = OVERLAY_KEY;
+                        k = nEnd;
+                    }
+                    else nKey = ESC;
+                    if (nKey >= 0) press(nKey, now);
+                }
+            }
+            now = chrono::steady_clock::now();
+            // nothing came after an ESC on its own: it was the Esc key; the start of a sequence is dropped
+            if (nPending > 0 && now >= escapeDeadline) {
+                if (nPending == 1) press(ESC, now);
+                nPending = 0;
+            }
+            for (int k = 0; k < nTerminalKeys; ++k)
+                if (released[k] <= now) {
+                    input.post((unsigned char)k, false);
+                    released[k] = noKey;
+                }
+        }
+    }
+
+
+    // Move the cursor to (x, y) with the shortest sequence that does it
+    void moveCursor(int x, int y) {
+        char szMove[32];
+        if (y == m_nCursorY && x == m_nCursorX) return;
+        if (y == m_nCursorY && m_nCursorX >= 0 && x > m_nCursorX) snprintf(szMove, sizeof(szMove), "\x1b[%dC", x - m_nCursorX);
+        else if (y == m_nCursorY && x == 0) strcpy(szMove, "\r");
+        else snprintf(szMove, sizeof(szMove), "\x1b[%d;%dH", y + 1, x + 1);
+        append(szMove);
+        m_nCursorX = x;
+        m_nCursorY = y;
+    }
+
+
+    // Switch to the colours of a console attribute; the terminal's own background stands for black
+    void setColour(WORD wAttributes) {
+        const int nForeground = ((wAttributes & FOREGROUND_RED) ? 1: 0) | ((wAttributes & FOREGROUND_GREEN) ? 2: 0) |
+            ((wAttributes & FOREGROUND_BLUE) ? 4: 0);
+        const int nBackground = ((wAttributes & BACKGROUND_RED) ? 1: 0) | ((wAttributes & BACKGROUND_GREEN) ? 2: 0) |
+            ((wAttributes & BACKGROUND_BLUE) ? 4: 0);
+        char szColour[32];
+        snprintf(szColour, sizeof(szColour), "\x1b[%d;%dm", ((wAttributes & FOREGROUND_INTENSITY) ? 90: 30) + nForeground,
+            (wAttributes & (BACKGROUND_RED | BACKGROUND_GREEN | BACKGROUND_BLUE | BACKGROUND_INTENSITY)) == 0 ? 49:
+            ((wAttributes & BACKGROUND_INTENSITY) ? 100: 40) + nBackground);
+        append(szColour);
+        m_wAttributes = wAttributes;
+    }
+
+
+    void appendUtf8(wchar_t c) {
+        const uint32_t u = (uint32_t)c;
+        if (u < 0x80) append((char)u);
+        else if (u < 0x800) {
+            append((char)(0xC0 | (u >> 6)));
+            append((char)(0x80 | (u & 0x3F)));
+        }
+        else if (u < 0x10000) {
+            append((char)(0xE0 | (u >> 12)));
+            append((char)(0x80 | ((u >> 6) & 0x3F)));
+            append((char)(0x80 | (u & 0x3F)));
+        }
+        else {
+            append((char)(0xF0 | (u >> 18)));
+            append((char)(0x80 | ((u >> 12) & 0x3F)));
+            append((char)(0x80 | ((u >> 6) & 0x3F)));
+            append((char)(0x80 | (u & 0x3F)));
+        }
+    }
+
+
+    // The longest output of a frame, every cell changed
+    static size_t maxFrameBytes() { return (size_t)nScreenWidth*nScreenHeight*MaxBytesPerCell + 64; }
+
+
+    void append(char c) { m_pOutput[m_nOutput++] = c; }
+
+
+    void append(const char* sz) {
+        const size_t nLength = strlen(sz);
+        memcpy(m_pOutput + m_nOutput, sz, nLength);
+        m_nOutput += nLength;
+    }
+
+
+    // Send nBytes to the terminal, all of them
+    void send(const char* p, size_t nBytes) {
+        while (nBytes > 0) {
+            const ssize_t nWritten = write(STDOUT_FILENO, p, nBytes);
+            if (nWritten < 0 && errno == EINTR) continue;
+            if (nWritten <= 0) break;
+            p += nWritten;
+            nBytes -= nWritten;
+        }
+    }
+};
+#endif
+
+
+// The terminal of the platform the game is built for
+unique_ptr<TerminalBackend> CreateTerminal()
+{
+#if defined(_WIN32)
+    return unique_ptr<TerminalBackend>(new Win32Console());
+#else
+    return unique_ptr<TerminalBackend>(new VtTerminal());
+#endif
+}
+
+
+
+/**
+ * Paces the frame loop at a fixed rate, sleeping away the time left in each frame
+ * instead of spinning on the CPU.
+ * 
+ * On Windows the wait uses a high resolution waitable timer where available (Windows 10
+ * 1803 and later); otherwise it falls back to a regular waitable timer, which is only as
+ * precise as the system tick. Elsewhere, sleeping is precise enough as it is.
+ * A target of 0 frames per second disables pacing altogether.
+ */
+struct FrameScheduler {
+    chrono::steady_clock::duration m_period;
+    chrono::steady_clock::time_point m_nextFrame;
+#if defined(_WIN32)
+    HANDLE m_hTimer;
+#endif
+
+
+    FrameScheduler(int nTargetFps): m_period(0) {
+#if defined(_WIN32)
+        m_hTimer = NULL;
+#endif
+        if (nTargetFps > 0) {
+            m_period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(1.0/nTargetFps));
+#if defined(_WIN32)
+            m_hTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+            if (m_hTimer == NULL) m_hTimer = CreateWaitableTimer(NULL, TRUE, NULL);
+#endif
+        }
+        m_nextFrame = chrono::steady_clock::now() + m_period;
+    }
+
+
+#if defined(_WIN32)
+    ~FrameScheduler() { if (m_hTimer != NULL) CloseHandle(m_hTimer); }
+#endif
+
+
+    // Block until the start of the next frame
+    void wait() {
+        if (m_period.count() == 0) return;
+        auto now = chrono::steady_clock::now();
+        if (now < m_nextFrame) {
+            bool bWaited = false;
+#if defined(_WIN32)
+            if (m_hTimer != NULL) {
+                // relative due times are negative, in units of 100ns
+                LARGE_INTEGER dueTime;
+                dueTime.QuadPart = -(LONGLONG)(chrono::duration_cast<chrono::nanoseconds>(m_nextFrame - now).count() / 100);
+                bWaited = SetWaitableTimer(m_hTimer, &dueTime, 0, NULL, NULL, FALSE) &&
+                    WaitForSingleObject(m_hTimer, INFINITE) == WAIT_OBJECT_0;
+            }
+#endif
+            if (! bWaited) this_thread::sleep_until(m_nextFrame);
+            m_nextFrame += m_period;
+        }
+        else {
+            // running late: start over from now, rather than rushing the next frames
+            m_nextFrame = now + m_period;
+        }
+    }
+};
+
+
+
+// A file mapped into memory, read only: its pages are read from disk as they are touched
+struct MappedFile {
+    const unsigned char* pData;
+    size_t nSize;
+#if defined(_WIN32)
+    HANDLE m_hFile;
+    HANDLE m_hMapping;
+
+
+    MappedFile(const string& path): pData(NULL), nSize(0), m_hMapping(NULL) {
+        m_hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        LARGE_INTEGER size;
+        if (m_hFile == INVALID_HANDLE_VALUE || ! GetFileSizeEx(m_hFile, &size)) throw runtime_error("cannot open " + path);
+        nSize = (size_t)size.QuadPart;
+        if (nSize == 0) return; // an empty file cannot be mapped
+        m_hMapping = CreateFileMappingA(m_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_hMapping != NULL) pData = (const unsigned char*)MapViewOfFile(m_hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (pData == NULL) {
+            if (m_hMapping != NULL) CloseHandle(m_hMapping);
+            CloseHandle(m_hFile);
+            throw runtime_error("cannot map " + path);
+        }
+    }
+
+
+    ~MappedFile() {
+        if (pData != NULL) UnmapViewOfFile(pData);
+        if (m_hMapping != NULL) CloseHandle(m_hMapping);
+        CloseHandle(m_hFile);
+    }
+#else
+    int m_fd;
+
+
+    MappedFile(const string& path): pData(NULL), nSize(0) {
+        struct stat st;
+        m_fd = open(path.c_str(), O_RDONLY);
+        if (m_fd < 0 || fstat(m_fd, &st) != 0) {
+            if (m_fd >= 0) ::close(m_fd);
+            throw runtime_error("cannot open " + path);
+        }
+        nSize = (size_t)st.st_size;
+        if (nSize == 0) return; // an empty file cannot be mapped
+        void* p = mmap(NULL, nSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(m_fd);
+            throw runtime_error("cannot map " + path);
+        }
+        madvise(p, nSize, MADV_SEQUENTIAL); // read ahead, as the file is played back from start to end
+        pData = (const unsigned char*)p;
+    }
+
+
+    ~MappedFile() {
+        if (pData != NULL) munmap((void*)pData, nSize);
+        ::close(m_fd);
+    }
+#endif
+
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+
+/**
+ * Recordings of a session hold the seed of the random numbers of the game, the size of the
+ * board and of the alien grid, the number of alien bullets allowed in flight, how often
+ * keyframes are taken and the size of a `GameState`; then the keys held during each step of
+ * the simulation follow (see `Step`). Games follow each other in the same stream: when one
+ * is over, or is given up by a record of its own, the next one starts at the following step.
+ * 
+ * The keys seldom change from one step to the next, so they are stored as runs: a byte with
+ * the keys that changed since the run before (the XOR of the two), then the length of the
+ * run as a LEB128 variable-length integer. An hour of play takes a few tens of kilobytes.
+ * Every `nKeyframeInterval` steps, a keyframe holds a copy of the GameState, so that a
+ * playback can start anywhere without simulating all the steps before. An index of the
+ * keyframes closes the file; a recording cut short (by a crash, say) has none, and can be
+ * played back all the same.
+ */
+static const char szReplayMagic[4] = {'C', 'I', 'R', '5'};
+static const char szReplayIndexMagic[4] = {'C', 'I', 'R', 'X'};
+
+// Records other than runs, which start with a byte below 0x80 (the keys that changed)
+enum ReplayRecord {
+    REPLAY_KEYFRAME = 0x80, // step (8 bytes), keys of the run before (1 byte), GameState
+    REPLAY_END = 0x81,      // followed by the index of the keyframes
+    REPLAY_GIVE_UP = 0x82   // the game in progress was given up before it was over
+};
+
+// Entry of the index of keyframes: the step of the keyframe, the offset of its record in the file
+struct ReplayIndexEntry {
+    uint64_t nStep;
+    uint64_t nOffset;
+};
+
+
+struct ReplayWriter {
+    ofstream m_file;
+    uint64_t m_nOffset;             // bytes written so far
+    uint64_t m_nStep;               // steps written so far
+    int m_nKeyframeInterval;        // 0: no keyframes
+    bool m_bResumed;                // the first step carries on with a game in progress
+    unsigned char m_nLastInput;     // keys of the last run written
+    unsigned char m_nRunInput;      // keys of the run in progress
+    uint64_t m_nRunLength;          // 0: no run in progress
+    // Keyframes indexed at most, 11 days of play at the default interval: the index is never
+    // resized while recording; the keyframes past it are left out, and seeking to them
+    // starts from the last keyframe indexed
+    static const size_t MaxIndexEntries = 16384;
+    vector<ReplayIndexEntry> m_index;
+
+
+    // bResumed: the recording starts in the middle of a game, which it keeps in a keyframe at
+    // step 0 whatever the interval, as there is no playing it back otherwise
+    ReplayWriter(const string& path, uint32_t seed, int nKeyframeInterval, bool bResumed): m_file(path, ios::binary),
+        m_nOffset(0), m_nStep(0), m_nKeyframeInterval(nKeyframeInterval), m_bResumed(bResumed), m_nLastInput(0),
+        m_nRunInput(0), m_nRunLength(0) {
+        if (! m_file) throw runtime_error("cannot create recording " + path);
+        m_index.reserve(MaxIndexEntries);
+        put(szReplayMagic, sizeof(szReplayMagic));
+        put(&seed, sizeof(seed));
+        const int32_t header[7] = {nScreenWidth, nScreenHeight, nAlienBlockWidth, nAlienBlockHeight, nMaxAlienBullets,
+            nKeyframeInterval, (int32_t)sizeof(GameState)};
+        put(header, sizeof(header));
+    }
+
+
+    // Close the stream of steps and append the index of the keyframes
+    ~ReplayWriter() {
+        endRun();
+        putByte(REPLAY_END);
+        const uint64_t nIndexOffset = m_nOffset;
+        const uint32_t nEntries = (uint32_t)m_index.size();
+        if (nEntries > 0) put(m_index.data(), nEntries*sizeof(ReplayIndexEntry));
+        put(&nEntries, sizeof(nEntries));
+        put(&nIndexOffset, sizeof(nIndexOffset));
+        put(szReplayIndexMagic, sizeof(szReplayIndexMagic));
+    }
+
+
+    // Record the keys held during the next step, played from `state`
+    void write(const GameState& state, unsigned char nInput) {
+        if ((m_nKeyframeInterval > 0 && m_nStep % m_nKeyframeInterval == 0) || (m_bResumed && m_nStep == 0)) {
+            endRun();
+            if (m_index.size() < MaxIndexEntries) m_index.push_back({m_nStep, m_nOffset});
+            putByte(REPLAY_KEYFRAME);
+            put(&m_nStep, sizeof(m_nStep));
+            putByte(m_nLastInput);
+            put(&state, sizeof(state));
+        }
+        if (m_nRunLength > 0 && nInput != m_nRunInput) endRun();
+        m_nRunInput = nInput;
+        ++m_nRunLength;
+        ++m_nStep;
+    }
+
+
+    // Record that the game in progress is given up: the next step starts a new one
+    void giveUp() {
+        endRun();
+        putByte(REPLAY_GIVE_UP);
+    }
+
+
+    // Write the run in progress, if any
+    void endRun() {
+        if (m_nRunLength == 0) return;
+        putByte(m_nRunInput ^ m_nLastInput);
+        for (uint64_t n = m_nRunLength; ; n >>= 7) {
+            if (n < 0x80) { putByte((unsigned char)n); break; }
+            putByte((unsigned char)(0x80 | (n & 0x7F)));
+        }
+        m_nLastInput = m_nRunInput;
+        m_nRunLength = 0;
+    }
+
+
+    void putByte(unsigned char b) { put(&b, 1); }
+
+
+    void put(const void* pData, size_t nBytes) {
+        m_file.write((const char*)pData, nBytes);
+        m_nOffset += nBytes;
+    }
+};
+
+
+/**
+ * Plays back a recording straight from the memory it is mapped to: nothing is read ahead of
+ * the step being played, so a recording of any length opens at once and costs no more memory
+ * than the pages of it being read.
+ */
+struct ReplayReader {
+    MappedFile m_file;
+    uint32_t seed;
+    int32_t board[5];               // board width and height, alien grid width and height, alien bullets
+    int32_t nKeyframeInterval;
+    int32_t m_nStateSize;           // size of the GameState of the keyframes
+    const unsigned char* m_pFirst;  // first record
+    const unsigned char* m_pNext;   // next record to decode
+    const unsigned char* m_pEnd;    // end of the records
+    const unsigned char* m_pIndex;  // the index of the keyframes, NULL if there is none
+    uint32_t m_nIndexEntries;
+    unsigned char m_nInput;         // keys of the current run
+    uint64_t m_nRunLeft;            // steps left in the current run
+    uint64_t nStep;                 // steps played back so far
+
+
+    // A record of the stream, decoded
+    struct Record {
+        bool bKeyframe;
+        unsigned char nKeys;        // run: the keys that changed; keyframe: the keys of the run before
+        uint64_t nValue;            // run: its length; keyframe: its step
+        const unsigned char* pState;
+    };
+
+
+    ReplayReader(const string& path): m_file(path), seed(0), m_pIndex(NULL), m_nIndexEntries(0), m_nInput(0),
+        m_nRunLeft(0), nStep(0) {
+        const unsigned char* p = m_file.pData;
+        int32_t header[7];
+        const size_t nHeaderSize = sizeof(szReplayMagic) + sizeof(seed) + sizeof(header);
+        if (m_file.nSize < nHeaderSize || memcmp(p, szReplayMagic, sizeof(szReplayMagic)) != 0)
+            throw runtime_error(path + " is not a recording");
+        memcpy(&seed, p + sizeof(szReplayMagic), sizeof(seed));
+        memcpy(header, p + sizeof(szReplayMagic) + sizeof(seed), sizeof(header));
+        memcpy(board, header, sizeof(board));
+        nKeyframeInterval = header[5];
+        m_nStateSize = header[6];
+        m_pFirst = m_pNext = p + nHeaderSize;
+        m_pEnd = p + m_file.nSize;
+        // the index, if the recording was closed properly
+        const size_t nTrailerSize = sizeof(uint32_t) + sizeof(uint64_t) + sizeof(szReplayIndexMagic);
+        if (m_file.nSize >= nHeaderSize + 1 + nTrailerSize &&
+            memcmp(m_pEnd - sizeof(szReplayIndexMagic), szReplayIndexMagic, sizeof(szReplayIndexMagic)) == 0) {
+            uint64_t nIndexOffset;
+            memcpy(&m_nIndexEntries, m_pEnd - nTrailerSize, sizeof(m_nIndexEntries));
+            memcpy(&nIndexOffset, m_pEnd - nTrailerSize + sizeof(uint32_t), sizeof(nIndexOffset));
+            if (nIndexOffset > nHeaderSize && nIndexOffset + (uint64_t)m_nIndexEntries*sizeof(ReplayIndexEntry) + nTrailerSize == m_file.nSize) {
+                m_pIndex = p + nIndexOffset;
+                m_pEnd = m_pIndex - 1; // REPLAY_END
+            }
+            else m_nIndexEntries = 0;
+        }
+    }
+
+
+    // Decode the record at p into *pRecord and return the one after it; NULL past the last record
+    const unsigned char* parse(const unsigned char* p, Record* pRecord) const {
+        if (p >= m_pEnd) return NULL;
+        if (*p == REPLAY_KEYFRAME) {
+            if (m_pEnd - p < (ptrdiff_t)(1 + sizeof(uint64_t) + 1) + m_nStateSize) return NULL;
+            pRecord->bKeyframe = true;
+            memcpy(&pRecord->nValue, p + 1, sizeof(uint64_t));
+            pRecord->nKeys = p[1 + sizeof(uint64_t)];
+            pRecord->pState = p + 1 + sizeof(uint64_t) + 1;
+            return pRecord->pState + m_nStateSize;
+        }
+        if (*p == REPLAY_GIVE_UP) {
+            pRecord->bKeyframe = false;
+            pRecord->nKeys = 0;
+            pRecord->nValue = 0;
+            return p + 1;
+        }
+        if (*p >= 0x80) return NULL; // REPLAY_END
+        pRecord->bKeyframe = false;
+        pRecord->nKeys = *p++;
+        pRecord->nValue = 0;
+        for (int nShift = 0; nShift < 64; nShift += 7) {
+            if (p == m_pEnd) return NULL; // cut short
+            const unsigned char b = *p++;
+            pRecord->nValue |= (uint64_t)(b & 0x7F) << nShift;
+            if (b < 0x80) return pRecord->nValue > 0 ? p: NULL;
+        }
+        return NULL;
+    }
+
+
+    // Fetch the input of the next step; false at the end of the recording
+    bool next(unsigned char& nInput) {
+        while (m_nRunLeft == 0) {
+            Record record;
+            const unsigned char* pAfter = parse(m_pNext, &record);
+            if (pAfter == NULL) return false;
+            m_pNext = pAfter;
+            if (record.bKeyframe || record.nValue == 0) continue; // a game given up: see gameGivenUp()
+            m_nInput ^= record.nKeys;
+            m_nRunLeft = record.nValue;
+        }
+        --m_nRunLeft;
+        ++nStep;
+        nInput = m_nInput;
+        return true;
+    }
+
+
+    // True, once, if the game in progress was given up before the next step, which starts a new game
+    bool gameGivenUp() {
+        if (m_nRunLeft > 0 || m_pNext >= m_pEnd || *m_pNext != REPLAY_GIVE_UP) return false;
+        ++m_pNext;
+        return true;
+    }
+
+
+    /**
+     * Bring `state` to the start of step nTarget of the recording and carry on playing back
+     * from there: from the last keyframe before it, looked up in the index (or found by
+     * skimming through the runs, if there is no index), or else from the start of the first
+     * game. Every playback starts here, at step 0 if not later: a recording that starts in
+     * the middle of a game does so from its keyframe at step 0. Returns false, with the
+     * playback at its end, if the recording is shorter.
+     */
+    bool seek(uint64_t nTarget, GameState& state) {
+        const unsigned char* pKeyframe = NULL;
+        if (m_pIndex != NULL) {
+            // the last entry at or before nTarget
+            uint32_t nLow = 0, nHigh = m_nIndexEntries;
+            while (nLow < nHigh) {
+                const uint32_t nMid = (nLow + nHigh) / 2;
+                ReplayIndexEntry entry;
+                memcpy(&entry, m_pIndex + nMid*sizeof(entry), sizeof(entry));
+                if (entry.nStep <= nTarget) nLow = nMid + 1;
+                else nHigh = nMid;
+            }
+            if (nLow > 0) {
+                ReplayIndexEntry entry;
+                memcpy(&entry, m_pIndex + (nLow - 1)*sizeof(entry), sizeof(entry));
+                pKeyframe = m_file.pData + entry.nOffset;
+            }
+        }
+        else {
+            uint64_t n = 0;
+            Record record;
+            for (const unsigned char* p = m_pFirst; n <= nTarget && (p = parse(p, &record)) != NULL; ) {
+                if (record.bKeyframe) pKeyframe = p - m_nStateSize - (1 + sizeof(uint64_t) + 1);
+                else n += record.nValue;
+            }
+        }
+        Record record;
+        if (pKeyframe != NULL && parse(pKeyframe, &record) != NULL && record.bKeyframe) {
+            if (m_nStateSize != (int32_t)sizeof(GameState))
+                throw runtime_error("the keyframes of the recording were taken by another build of the game");
+            memcpy(&state, record.pState, sizeof(GameState));
+            m_pNext = record.pState + m_nStateSize;
+            m_nInput = record.nKeys;
+            nStep = record.nValue;
+        }
+        else {
+            m_pNext = m_pFirst;
+            m_nInput = 0;
+            nStep = 0;
+            InitGame(state, seed, 0);
+        }
+        m_nRunLeft = 0;
+        // simulate the steps from there on, the games following each other as when playing
+        while (nStep < nTarget) {
+            unsigned char nInput;
+            const bool bGivenUp = gameGivenUp();
+            if (! next(nInput)) return false;
+            if (state.bGameOver || bGivenUp) InitGame(state, seed, state.nGame + 1);
+            Step(state, nInput);
+        }
+        // a game given up right there is over as far as the playback goes
+        if (gameGivenUp()) state.bGameOver = true;
+        return true;
+    }
+};
+
+
+// Scripted player for headless games: holds a random combination of keys for a random time
+struct Bot {
+    Random m_rng;
+    unsigned char m_nInput;
+    int m_nHoldSteps;
+
+
+    // The player of game nGame of the session seeded from `seed`
+    Bot(uint32_t seed, int nGame): m_rng(GameSeed(seed, nGame) ^ 0x5bd1e995u), m_nInput(0), m_nHoldSteps(0) {}
+
+
+    unsigned char next() {
+        if (m_nHoldSteps-- <= 0) {
+            const uint32_t r = m_rng.next();
+            const int nMove = r % 3; // stay, left, right
+            m_nInput = (unsigned char)(nMove == 1 ? (1 << LEFT_ARROW): nMove == 2 ? (1 << RIGHT_ARROW): 0);
+            if ((r >> 4) % 4 != 0) m_nInput |= 1 << SPACEBAR;
+            m_nHoldSteps = 10 + (r >> 8) % 50;
+        }
+        return m_nInput;
+    }
+};
+
+
+// Reads the keyboard on a thread of its own, as long as it lives
+struct InputThread {
+    InputQueue queue;
+    atomic<bool> m_bStop;
+    thread m_thread;
+
+
+    InputThread(TerminalBackend& terminal): m_bStop(false),
+        m_thread([this, &terminal]() {
+            NoAllocationScope noAllocation("the input thread");
+            terminal.readInput(queue, m_bStop);
+        }) {}
+
+
+    ~InputThread() { stop(); }
+
+
+    void stop() {
+        m_bStop = true;
+        if (m_thread.joinable()) m_thread.join();
+    }
+};
+
+
+// The keys held, kept up to date by the events of the input thread
+struct KeyboardState {
+    unsigned char nHeld;        // player keys held down, in the format taken by `Step`
+    unsigned char nPressed;     // player keys pressed since the last drain, even if already let go
+    bool bOverlayPressed;       // F3 pressed since the last drain
+
+
+    KeyboardState(): nHeld(0), nPressed(0), bOverlayPressed(false) {}
+
+
+    // Take in the events queued since the last call; returns the input for the next step,
+    // in which a tap shorter than a step still counts
+    unsigned char drain(InputQueue& input) {
+        nPressed = 0;
+        bOverlayPressed = false;
+        KeyEvent event;
+        while (input.pop(&event)) {
+            if (event.bDown) inputLatency.add(chrono::duration<float>(chrono::steady_clock::now() - event.time).count());
+            if (event.nKey == OVERLAY_KEY) {
+                bOverlayPressed = bOverlayPressed || event.bDown;
+                continue;
+            }
+            const unsigned char nBit = (unsigned char)(1 << event.nKey);
+            if (event.bDown) {
+                nHeld |= nBit;
+                nPressed |= nBit;
+            }
+            else nHeld &= ~nBit;
+        }
+        return nHeld | nPressed;
+    }
+};
+
+
+
+/**
+ * Hands the latest of a stream of values from one thread to another, without locks and
+ * without either of them ever waiting for the other: the writer fills the back buffer while
+ * the reader holds the front one, and a third buffer in the middle is swapped with either.
+ * The reader always gets the latest value published; those it had no time for are skipped.
+ */
+template <typename T>
+struct TripleBuffer {
+    static const int FreshBit = 4;  // set in m_nMiddle when it holds a value not read yet
+    T m_buffers[3];
+    atomic<int> m_nMiddle;
+    int m_nBack;    // writer only
+    int m_nFront;   // reader only
+
+
+    TripleBuffer(): m_nMiddle(1), m_nBack(0), m_nFront(2) {}
+
+
+    // Writer side: the buffer to fill, and the call that makes it the latest value
+    T& back() { return m_buffers[m_nBack]; }
+
+
+    void publish() { m_nBack = m_nMiddle.exchange(m_nBack | FreshBit, memory_order_acq_rel) & ~FreshBit; }
+
+
+    // Reader side: take the latest value published, if there is one that was not read yet
+    bool update() {
+        if ((m_nMiddle.load(memory_order_relaxed) & FreshBit) == 0) return false;
+        m_nFront = m_nMiddle.exchange(m_nFront, memory_order_acq_rel) & ~FreshBit;
+        return true;
+    }
+
+
+    const T& front() const { return m_buffers[m_nFront]; }
+};
+
+
+/**
+ * Presents the frames on a thread of its own, so that however long the terminal takes to
+ * show a frame, the game loop does not wait for it: the loop submits frames into a triple
+ * buffer and goes on, the thread shows the latest one whenever it is ready for more. The
+ * frames change hands without locks; the mutex is there for the thread to sleep on while
+ * there is no frame, and to hand back the timings of the last present.
+ */
+struct PresentThread {
+    TerminalBackend& m_terminal;
+    TripleBuffer<vector<CHAR_INFO>> m_frames;
+    mutex m_mutex;
+    condition_variable m_submitted;
+    atomic<bool> m_bStop;
+    atomic<int> nCellsWritten;  // cells sent to the terminal for the last frame shown
+    // when the thread started and finished showing the last frame, for the profiler
+    chrono::steady_clock::time_point m_presentStart;
+    chrono::steady_clock::time_point m_presentEnd;
+    bool m_bPresented;
+    thread m_thread;
+
+
+    PresentThread(TerminalBackend& terminal): m_terminal(terminal), m_bStop(false), nCellsWritten(0), m_bPresented(false) {
+        for (auto& frame: m_frames.m_buffers) frame.resize(nScreenWidth*nScreenHeight);
+        m_thread = thread([this]() { run(); });
+    }
+
+
+    ~PresentThread() { stop(); }
+
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_bStop = true;
+        }
+        m_submitted.notify_one();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+
+    // Game loop: hand over a copy of the frame; the previous one is dropped if not shown yet
+    void submit(const CHAR_INFO* pFrame) {
+        memcpy(m_frames.back().data(), pFrame, nScreenWidth*nScreenHeight*sizeof(CHAR_INFO));
+        m_frames.publish();
+        // ring the thread; taking the lock, if only for a moment, makes sure it is not between
+        // seeing no frame and going to sleep
+        { lock_guard<mutex> lock(m_mutex); }
+        m_submitted.notify_one();
+    }
+
+
+    // Game loop: when the last frame shown was presented, once; false if it was told already
+    bool lastPresent(chrono::steady_clock::time_point* pStart, chrono::steady_clock::time_point* pEnd) {
+        lock_guard<mutex> lock(m_mutex);
+        if (! m_bPresented) return false;
+        *pStart = m_presentStart;
+        *pEnd = m_presentEnd;
+        m_bPresented = false;
+        return true;
+    }
+
+
+    void run() {
+        NoAllocationScope noAllocation("the present thread");
+        while (true) {
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_submitted.wait(lock, [this]() { return m_bStop || m_frames.update(); });
+                if (m_bStop) return;
+            }
+            const auto start = chrono::steady_clock::now();
+            nCellsWritten = m_terminal.present(m_frames.front().data());
+            const auto end = chrono::steady_clock::now();
+            lock_guard<mutex> lock(m_mutex);
+            m_presentStart = start;
+            m_presentEnd = end;
+            m_bPresented = true;
+        }
+    }
+};
+
+
+/**
+ * A UDP socket that never blocks: a datagram that cannot be sent at once is dropped, and
+ * receive() returns at once when none has arrived.
+ */
+struct UdpSocket {
+#if defined(_WIN32)
+    typedef SOCKET Handle;
+#else
+    typedef int Handle;
+    static const Handle INVALID_SOCKET = -1;
+#endif
+    Handle m_socket;
+
+
+    UdpSocket(): m_socket(INVALID_SOCKET) {
+#if defined(_WIN32)
+        WSADATA data;
+        if (WSAStartup(MAKEWORD(2, 2), &data) != 0) throw runtime_error("cannot start Windows Sockets");
+#endif
+    }
+
+
+    ~UdpSocket() {
+        if (m_socket == INVALID_SOCKET) return;
+#if defined(_WIN32)
+        closesocket(m_socket);
+#else
+        close(m_socket);
+#endif
+    }
+
+
+    // Send from any local port to "host:port"
+    void connect(const string& address) {
+        const size_t nColon = address.rfind(':');
+        if (nColon == string::npos) throw runtime_error("no port in " + address + ", expected host:port");
+        const string host = address.substr(0, nColon), port = address.substr(nColon + 1);
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_DGRAM;
+        addrinfo* pAddresses = NULL;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &pAddresses) != 0 || pAddresses == NULL)
+            throw runtime_error("cannot resolve " + address);
+        open();
+        const bool bConnected = ::connect(m_socket, pAddresses->ai_addr, (int)pAddresses->ai_addrlen) == 0;
+        freeaddrinfo(pAddresses);
+        if (! bConnected) throw runtime_error("cannot send to " + address);
+    }
+
+
+    // Receive what is sent to nPort, on every interface
+    void bind(int nPort) {
+        open();
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons((unsigned short)nPort);
+        if (::bind(m_socket, (const sockaddr*)&address, sizeof(address)) != 0)
+            throw runtime_error("cannot listen on port " + to_string(nPort));
+    }
+
+
+    // False if the datagram was dropped
+    bool send(const void* pData, size_t nBytes) {
+        return ::send(m_socket, (const char*)pData, (int)nBytes, 0) == (int)nBytes;
+    }
+
+
+    // Size of the datagram received into pData, -1 if there is none
+    int receive(void* pData, size_t nBytes) {
+        return (int)::recv(m_socket, (char*)pData, (int)nBytes, 0);
+    }
+
+
+    // Wait at most nMilliseconds for a datagram to arrive; true if one has
+    bool wait(int nMilliseconds) {
+#if defined(_WIN32)
+        WSAPOLLFD fd = {m_socket, POLLIN, 0};
+        return WSAPoll(&fd, 1, nMilliseconds) > 0;
+#else
+        pollfd fd = {m_socket, POLLIN, 0};
+        return poll(&fd, 1, nMilliseconds) > 0;
+#endif
+    }
+
+
+    void open() {
+        m_socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (m_socket == INVALID_SOCKET) throw runtime_error("cannot create a socket");
+#if defined(_WIN32)
+        u_long nNonBlocking = 1;
+        ioctlsocket(m_socket, FIONBIO, &nNonBlocking);
+#else
+        fcntl(m_socket, F_SETFL, fcntl(m_socket, F_GETFL) | O_NONBLOCK);
+#endif
+    }
+};
+
+
+/**
+ * Telemetry messages, one UDP datagram each, tell what changed in a game since the message
+ * before, in the byte order of the machine:
+ * - the magic "CIT1"; the sequence number of the message (uint32); the sequence number of
+ *   the message it builds on (uint32), the same for a keyframe; the step of the game (uint32)
+ * - keyframes only: the board, int16[4] = {W, H, GW, GH}
+ * - the player and the formation: fPlayerX (float), nPlayerY, nAlienBlockX, nAlienBlockY
+ *   (int16), nFrameOffset (uint8), nScore (int32), nLives (uint8), flags (uint8: bit 0 game
+ *   over, 1 player hit, 2 the player's bullet is in flight), then the x and y (float) of the
+ *   player's bullet
+ * - the words of the alien grid that changed: their number (uint16), then for each, its
+ *   index (uint16) and the new alive and exploding bits (uint64 each)
+ * - the cells of the shields that changed: their number (uint16), then for each, its index
+ *   in the obstacle grid (uint16) and its new strength (uint8)
+ * - the alien bullets, which all move on every step: their number (uint16), then the
+ *   column and row (int16) of each
+ * A keyframe is the difference with an empty board, so it stands on its own; a viewer that
+ * lost a message skips the ones that build on it until the next keyframe.
+ */
+static const char szTelemetryMagic[4] = {'C', 'I', 'T', '1'};
+static const size_t TelemetryHeaderBytes = 4 + 3*4 + 4*2;
+static const size_t TelemetryPlayerBytes = 4 + 3*2 + 1 + 4 + 1 + 1 + 2*4;
+// the largest message, that of a largest board that changed everywhere at once
+static const size_t MaxTelemetryBytes = TelemetryHeaderBytes + TelemetryPlayerBytes +
+    2 + AlienGrid::MaxRows*AlienGrid::MaxWordsPerRow*(2 + 2*8) +
+    2 + ObstacleGrid::Rows*ObstacleGrid::MaxWidth*(2 + 1) +
+    2 + BulletPool::MaxCapacity*2*2;
+static_assert(MaxTelemetryBytes <= 65507, "a telemetry message must fit in a UDP datagram");
+enum {
+    TELEMETRY_GAME_OVER = 1,
+    TELEMETRY_PLAYER_HIT = 2,
+    TELEMETRY_BULLET = 4
+};
+
+
+// Appends values to a message, as they lie in memory
+struct MessageWriter {
+    unsigned char* m_p;
+
+    template <typename T>
+    void put(T value) {
+        memcpy(m_p, &value, sizeof(value));
+        m_p += sizeof(value);
+    }
+};
+
+
+// Reads values from a message; once past its end, every value read is 0 and bOk is false
+struct MessageReader {
+    const unsigned char* m_p;
+    const unsigned char* m_pEnd;
+    bool bOk;
+
+    MessageReader(const unsigned char* p, size_t nBytes): m_p(p), m_pEnd(p + nBytes), bOk(true) {}
+
+    template <typename T>
+    T get() {
+        T value = T();
+        if ((size_t)(m_pEnd - m_p) < sizeof(value)) bOk = false;
+        else memcpy(&value, m_p, sizeof(value));
+        m_p += bOk ? sizeof(value): 0;
+        return value;
+    }
+};
+
+
+/**
+ * Write into pMessage what changed from `base` to `state`, as message nSequence building on
+ * message nBase; a keyframe (nBase == nSequence) needs an empty base. Returns the size of the
+ * message, at most MaxTelemetryBytes.
+ */
+size_t EncodeTelemetry(const GameState& state, const GameState& base, uint32_t nSequence, uint32_t nBase, unsigned char* pMessage)
+{
+    MessageWriter out = {pMessage};
+    for (char c: szTelemetryMagic) out.put(c);
+    out.put(nSequence);
+    out.put(nBase);
+    out.put((uint32_t)state.nStep);
+    if (nBase == nSequence) {
+        out.put((int16_t)nScreenWidth);
+        out.put((int16_t)nScreenHeight);
+        out.put((int16_t)nAlienBlockWidth);
+        out.put((int16_t)nAlienBlockHeight);
+    }
+    out.put(state.fPlayerX);
+    out.put((int16_t)state.nPlayerY);
+    out.put((int16_t)state.nAlienBlockX);
+    out.put((int16_t)state.nAlienBlockY);
+    out.put((uint8_t)state.nFrameOffset);
+    out.put((int32_t)state.nScore);
+    out.put((uint8_t)state.nLives);
+    out.put((uint8_t)((state.bGameOver ? TELEMETRY_GAME_OVER: 0) | (state.bPlayerHit ? TELEMETRY_PLAYER_HIT: 0) |
+        (state.bullet.visible ? TELEMETRY_BULLET: 0)));
+    out.put(state.bullet.x);
+    out.put(state.bullet.y);
+    // the words of the grid that changed, counted once they are written
+    unsigned char* pCount = out.m_p;
+    out.put((uint16_t)0);
+    uint16_t nChanged = 0;
+    const int nWords = RuntimeBoard::wordsPerRow()*nAlienBlockHeight;
+    for (int w = 0; w < nWords; ++w)
+        if (state.aliens.m_alive[w] != base.aliens.m_alive[w] || state.aliens.m_exploding[w] != base.aliens.m_exploding[w]) {
+            out.put((uint16_t)w);
+            out.put(state.aliens.m_alive[w]);
+            out.put(state.aliens.m_exploding[w]);
+            ++nChanged;
+        }
+    memcpy(pCount, &nChanged, sizeof(nChanged));
+    // the cells of the shields that changed
+    pCount = out.m_p;
+    out.put((uint16_t)0);
+    nChanged = 0;
+    const int nCells = ObstacleGrid::Rows*nScreenWidth;
+    for (int k = 0; k < nCells; ++k)
+        if (state.obstacles.m_strength[k] != base.obstacles.m_strength[k]) {
+            out.put((uint16_t)k);
+            out.put(state.obstacles.m_strength[k]);
+            ++nChanged;
+        }
+    memcpy(pCount, &nChanged, sizeof(nChanged));
+    out.put((uint16_t)state.alienBullets.nLive);
+    for (int k = 0; k < state.alienBullets.nLive; ++k) {
+        out.put((int16_t)roundf(state.alienBullets.x[k]));
+        out.put((int16_t)roundf(state.alienBullets.y[k]));
+    }
+    return out.m_p - pMessage;
+}
+
+
+/**
+ * Sends what happens in a game to a viewer, on a thread of its own, so that the game loop
+ * never waits for the network: the loop offers its state at most `nRate` times a second,
+ * into a triple buffer, and goes on. The thread sends the latest state offered as the
+ * difference with the last one it sent, and waits between messages for as long as the
+ * bandwidth allows; the states offered in the meantime are dropped, never queued.
+ * 
+ * A message is a keyframe once a second of the clock has passed since the last keyframe
+ * sent, for viewers that join late or lost messages: however few messages the bandwidth
+ * lets through, a viewer is never more than a second and a message away from resyncing.
+ */
+struct TelemetryPublisher {
+    UdpSocket m_socket;
+    chrono::steady_clock::duration m_period;    // shortest time between two messages
+    chrono::steady_clock::duration m_keyframePeriod;    // time between keyframes
+    double m_fBandwidth;                        // bytes per second; 0: unlimited
+    TripleBuffer<GameState> m_states;
+    mutex m_mutex;
+    condition_variable m_offered;
+    bool m_bStop;
+    chrono::steady_clock::time_point m_nextOffer;   // game loop only
+    long long m_nOffered;                           // game loop only
+    // telemetry thread only
+    GameState m_empty;
+    GameState m_last;           // the state as the last message sent told it, the base of the next one
+    chrono::steady_clock::time_point m_nextKeyframe;    // the first message sent from then on is a keyframe
+    uint32_t m_nSequence;       // of the next message
+    uint32_t m_nBase;
+    vector<unsigned char> m_message;
+    atomic<long long> nSent;    // messages
+    atomic<long long> nBytes;
+    thread m_thread;
+
+
+    TelemetryPublisher(const string& address, int nRate, int nBandwidth): m_period(chrono::seconds(1)),
+        m_keyframePeriod(chrono::seconds(1)), m_fBandwidth(nBandwidth), m_bStop(false), m_nOffered(0),
+        m_empty(), m_nextKeyframe(), m_nSequence(0), m_nBase(0), m_message(MaxTelemetryBytes), nSent(0), nBytes(0) {
+        m_socket.connect(address);
+        m_period /= max(nRate, 1);
+        m_thread = thread([this]() { run(); });
+    }
+
+
+    ~TelemetryPublisher() { stop(); }
+
+
+    void stop() {
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_bStop = true;
+        }
+        m_offered.notify_one();
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+
+    // Game loop: hand over a copy of the state, unless one was offered less than a period ago
+    void offer(const GameState& state) {
+        const auto now = chrono::steady_clock::now();
+        if (now < m_nextOffer) return;
+        m_nextOffer = now + m_period;
+        m_states.back() = state;
+        m_states.publish();
+        ++m_nOffered;
+        { lock_guard<mutex> lock(m_mutex); }
+        m_offered.notify_one();
+    }
+
+
+    // States offered that were never sent, replaced by a later one or dropped by the network
+    long long dropped() const { return m_nOffered - nSent; }
+
+
+    void run() {
+        NoAllocationScope noAllocation("the telemetry thread");
+        while (true) {
+            {
+                unique_lock<mutex> lock(m_mutex);
+                m_offered.wait(lock, [this]() { return m_bStop || m_states.update(); });
+                if (m_bStop) return;
+            }
+            const GameState& state = m_states.front();
+            const auto sent = chrono::steady_clock::now();
+            const bool bKeyframe = sent >= m_nextKeyframe;
+            const size_t nMessage = EncodeTelemetry(state, bKeyframe ? m_empty: m_last, m_nSequence,
+                bKeyframe ? m_nSequence: m_nBase, m_message.data());
+            // a message the network did not take is no base for the next one
+            if (m_socket.send(m_message.data(), nMessage)) {
+                if (bKeyframe) m_nextKeyframe = sent + m_keyframePeriod;
+                m_last = state;
+                m_nBase = m_nSequence++;
+                ++nSent;
+                nBytes += nMessage;
+            }
+            // pace the messages after the bandwidth, whatever the game loop offers
+            chrono::steady_clock::duration wait = m_period;
+            if (m_fBandwidth > 0.0)
+                wait = max(wait, chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(nMessage / m_fBandwidth)));
+            unique_lock<mutex> lock(m_mutex);
+            m_offered.wait_until(lock, sent + wait, [this]() { return m_bStop; });
+            if (m_bStop) return;
+        }
+    }
+};
+
+
+/**
+ * Builds the state of a game, enough of it to draw it, from the telemetry messages sent by a
+ * TelemetryPublisher. Messages are checked before they are taken in: a malformed one, or one
+ * that does not build on the state as it is, is ignored, and the state waits for the next
+ * keyframe.
+ */
+struct TelemetryReader {
+    GameState state;
+    GameState m_next;       // the state being built from a message
+    bool m_bSynced;         // false until a keyframe is taken in, and after a message is lost
+    uint32_t m_nSequence;   // of the last message taken in
+    long long nIgnored;     // messages out of sequence, malformed or of another board
+
+
+    TelemetryReader(): state(), m_next(), m_bSynced(false), m_nSequence(0), nIgnored(0) {}
+
+
+    // True IFF pMessage is a keyframe; *pBoard is then the board it is played on
+    static bool keyframe(const unsigned char* pMessage, size_t nBytes, int16_t* pBoard) {
+        MessageReader in(pMessage, nBytes);
+        for (char c: szTelemetryMagic) if (in.get<char>() != c) return false;
+        if (in.get<uint32_t>() != in.get<uint32_t>()) return false;
+        in.get<uint32_t>();
+        for (int k = 0; k < 4; ++k) pBoard[k] = in.get<int16_t>();
+        return in.bOk;
+    }
+
+
+    // Take in a message; true IFF the state changed
+    bool apply(const unsigned char* pMessage, size_t nBytes) {
+        if (parse(pMessage, nBytes)) {
+            memcpy(&state, &m_next, sizeof(GameState));
+            m_bSynced = true;
+            return true;
+        }
+        ++nIgnored;
+        return false;
+    }
+
+
+    bool parse(const unsigned char* pMessage, size_t nBytes) {
+        MessageReader in(pMessage, nBytes);
+        for (char c: szTelemetryMagic) if (in.get<char>() != c) return false;
+        const uint32_t nSequence = in.get<uint32_t>(), nBase = in.get<uint32_t>();
+        const uint32_t nStep = in.get<uint32_t>();
+        const bool bKeyframe = nSequence == nBase;
+        if ( ! bKeyframe && ( ! m_bSynced || nBase != m_nSequence)) return false;
+        if (bKeyframe) {
+            if (in.get<int16_t>() != nScreenWidth || in.get<int16_t>() != nScreenHeight ||
+                in.get<int16_t>() != nAlienBlockWidth || in.get<int16_t>() != nAlienBlockHeight) return false;
+            m_next = GameState();
+            m_next.obstacles.nTop = Shield::row(nScreenHeight);
+            m_next.aliens.nWordsPerRow = RuntimeBoard::wordsPerRow();
+        }
+        else memcpy(&m_next, &state, sizeof(GameState));
+        GameState& next = m_next;
+        next.nStep = nStep;
+        next.fPlayerX = in.get<float>();
+        next.nPlayerY = in.get<int16_t>();
+        next.nAlienBlockX = in.get<int16_t>();
+        next.nAlienBlockY = in.get<int16_t>();
+        next.nFrameOffset = in.get<uint8_t>();
+        next.nScore = in.get<int32_t>();
+        next.nLives = in.get<uint8_t>();
+        const uint8_t nFlags = in.get<uint8_t>();
+        next.bGameOver = (nFlags & TELEMETRY_GAME_OVER) != 0;
+        next.bPlayerHit = (nFlags & TELEMETRY_PLAYER_HIT) != 0;
+        next.bullet.visible = (nFlags & TELEMETRY_BULLET) != 0;
+        next.bullet.x = in.get<float>();
+        next.bullet.y = in.get<float>();
+        const int nWords = RuntimeBoard::wordsPerRow()*nAlienBlockHeight;
+        for (int n = in.get<uint16_t>(); n > 0; --n) {
+            const int w = in.get<uint16_t>();
+            if (w >= nWords) return false;
+            next.aliens.m_alive[w] = in.get<uint64_t>();
+            next.aliens.m_exploding[w] = in.get<uint64_t>();
+        }
+        const int nCells = ObstacleGrid::Rows*nScreenWidth;
+        for (int n = in.get<uint16_t>(); n > 0; --n) {
+            const int k = in.get<uint16_t>();
+            const unsigned char nStrength = in.get<unsigned char>();
+            if (k >= nCells || nStrength > Shield::MaxStrength) return false;
+            next.obstacles.m_strength[k] = nStrength;
+        }
+        next.alienBullets.nLive = in.get<uint16_t>();
+        if (next.alienBullets.nLive > BulletPool::MaxCapacity) return false;
+        for (int k = 0; k < next.alienBullets.nLive; ++k) {
+            next.alienBullets.x[k] = in.get<int16_t>();
+            next.alienBullets.y[k] = in.get<int16_t>();
+            if ( ! onScreen(next.alienBullets.x[k], next.alienBullets.y[k])) return false;
+        }
+        if ( ! in.bOk || in.m_p != in.m_pEnd) return false;
+        // what is drawn without clipping must be on the screen
+        if ((next.bullet.visible && ! onScreen(roundf(next.bullet.x), roundf(next.bullet.y))) ||
+            ! (next.fPlayerX >= 0.0f && next.fPlayerX <= nScreenWidth - nPlayerWidth) ||
+            next.nPlayerY < 0 || next.nPlayerY >= nScreenHeight ||
+            (next.nFrameOffset != 0 && next.nFrameOffset != nAlienGlyphWidth) || ! formationOnScreen(next))
+            return false;
+        m_nSequence = nSequence;
+        return true;
+    }
+
+
+    static bool onScreen(float x, float y) { return x >= 0 && x < nScreenWidth && y >= 0 && y < nScreenHeight; }
+
+
+    // True IFF every living alien is on the screen, or below it (the rows below are not drawn)
+    static bool formationOnScreen(const GameState& state) {
+        const int nWordsPerRow = RuntimeBoard::wordsPerRow();
+        for (int i = 0; i < nAlienBlockHeight; ++i)
+            for (int w = 0; w < nWordsPerRow; ++w) {
+                const uint64_t bits = state.aliens.m_alive[i*nWordsPerRow + w];
+                if (bits == 0) continue;
+                const int nFirst = 64*w + LowestBit(bits), nLast = 64*w + HighestBit(bits);
+                if (state.nAlienBlockY + 2*i < 0 || nLast >= nAlienBlockWidth) return false;
+                if (state.nAlienBlockX + 6*nFirst < 0 || state.nAlienBlockX + 6*nLast + nAlienGlyphWidth > nScreenWidth)
+                    return false;
+            }
+        return true;
+    }
+};
+
+
+// Keeps the compiler from optimizing away the results of the kernels under test
+volatile int nBenchSink;
+// Called after every run of a kernel: the compiler cannot see through it, so it must assume
+// the call reads the screen buffer and game state, and cannot skip or merge runs of the kernel
+void (*volatile pfnBenchBarrier)() = []() {};
+
+
+/**
+ * Time `kernel` in isolation and print one line of results.
+ * 
+ * The kernel is run in batches sized to take about a millisecond each; the statistics are
+ * taken over the batches, so they show the spread between runs as well as the average.
+ * `nItems` is the amount of work done by one call (cells, aliens, ...), for the throughput.
+ */
+template <typename Kernel>
+void Benchmark(const char* szName, const char* szBoard, int nItems, Kernel kernel)
+{
+    typedef chrono::steady_clock Clock;
+    const int nSamples = 50;
+    // calibrate the batch size on a warm cache
+    long long nBatch = 1;
+    for (;;) {
+        auto t0 = Clock::now();
+        for (long long k = 0; k < nBatch; ++k) { kernel(); pfnBenchBarrier(); }
+        if (Clock::now() - t0 >= chrono::milliseconds(1) || nBatch >= (1LL << 30)) break;
+        nBatch *= 2;
+    }
+    double fSum = 0.0, fSumSq = 0.0, fMin = 1e30;
+    for (int n = 0; n < nSamples; ++n) {
+        auto t0 = Clock::now();
+        for (long long k = 0; k < nBatch; ++k) { kernel(); pfnBenchBarrier(); }
+        chrono::duration<double, nano> elapsed = Clock::now() - t0;
+        const double fNsPerOp = elapsed.count() / nBatch;
+        fSum += fNsPerOp;
+        fSumSq += fNsPerOp*fNsPerOp;
+        fMin = min(fMin, fNsPerOp);
+    }
+    const double fMean = fSum / nSamples;
+    const double fStdDev = sqrt(max(0.0, fSumSq/nSamples - fMean*fMean));
+    printf("%-20s %-16s %12.1f %10.1f %12.1f %14.1f\n", szName, szBoard, fMean, fStdDev, fMin,
+        nItems * 1e3 / fMean);
+}
+
+
+
+// Time the kernels compiled for a board on a copy of `state`, a game in progress; probes are bullets to test for hits
+template <class Board>
+void BenchmarkKernels(const char* szBoard, GameState state, const vector<Bullet>& probes)
+{
+    const int nProbes = (int)probes.size();
+    int nProbe = 0;
+    const int nCells = nScreenWidth*nScreenHeight;
+    const int nGrid = nAlienBlockWidth*nAlienBlockHeight;
+    const int nShieldCells = state.nShields*Shield::Length*Shield::Height;
+    Benchmark("ClearBuffer", szBoard, nCells, [&]() { ClearBuffer<Board>(screen); });
+    Benchmark("DrawAliens", szBoard, nGrid, [&]() { DrawAliens<Board>(state, screen); });
+    Benchmark("DrawShields", szBoard, nShieldCells, [&]() { DrawShields<Board>(state, screen); });
+    Benchmark("DrawBullets", szBoard, state.alienBullets.nLive + 1, [&]() { DrawBullets<Board>(state.alienBullets, &state.bullet); });
+    // a whole frame: as drawn when only the sprites moved, and from scratch
+    Benchmark("DrawGame", szBoard, nCells, [&]() { compositor.compose<Board>(state); });
+    Benchmark("DrawGame redrawn", szBoard, nCells, [&]() {
+        compositor.m_bValid = false;
+        compositor.compose<Board>(state);
+    });
+    Benchmark("HitAlien", szBoard, 1, [&]() {
+        int i, j;
+        const Bullet& probe = probes[nProbe++ % nProbes];
+        nBenchSink += HitAlien<Board>(state, (int)probe.x, (int)probe.y, &i, &j);
+    });
+    Benchmark("UpdateAlienFiring", szBoard, nAlienBlockWidth, [&]() {
+        state.alienBullets.clear();
+        UpdateAlienFiring<Board>(state);
+    });
+}
+
+
+/**
+ * Micro-benchmarks of the kernels run on every frame, on a game in progress: the formation
+ * is partly destroyed, the shields are damaged and all bullets are in flight.
+ */
+void BenchmarkBoard(int nWidth, int nHeight, int nGridWidth, int nGridHeight, int nMaxAlienBullets)
+{
+    ConfigureBoard(nWidth, nHeight, nGridWidth, nGridHeight, nMaxAlienBullets);
+    GameState state;
+    InitGame(state, 1, 0);
+    for (int k = 0; k < nAlienBlockWidth*nAlienBlockHeight; k += 3) {
+        state.aliens.kill(k / nAlienBlockWidth, k % nAlienBlockWidth);
+        state.aliens.remove(k / nAlienBlockWidth, k % nAlienBlockWidth);
+    }
+    for (int n = 0; n < state.nShields; ++n) {
+        const Shield& shld = state.shields[n];
+        for (int k = 0; k < Shield::Length*Shield::Height; k += 2)
+            state.obstacles.at(shld.nX + k % Shield::Length, shld.nY + k / Shield::Length) = k % Shield::MaxStrength;
+    }
+    Random& rng = state.rng;
+    while (state.alienBullets.acquire((float)(rng.next() % nScreenWidth), (float)(1 + rng.next() % (nScreenHeight - 1)), state.fAlienBulletSpeed))
+        ;
+    state.bullet.visible = true;
+    state.bullet.x = state.fPlayerX + 1.0f;
+    state.bullet.y = (float)(nScreenHeight / 2);
+    // bullet positions sweeping the formation and the shields, for the hit tests
+    const int nProbes = 256;
+    vector<Bullet> probes(nProbes);
+    for (int k = 0; k < nProbes; ++k) {
+        probes[k].x = (float)(state.nAlienBlockX + rng.next() % (6*nAlienBlockWidth));
+        probes[k].y = (float)(state.nAlienBlockY + 1 + rng.next() % (2*nAlienBlockHeight));
+    }
+
+    char szBoard[32];
+    snprintf(szBoard, sizeof(szBoard), "%dx%d/%dx%d", nScreenWidth, nScreenHeight, nAlienBlockWidth, nAlienBlockHeight);
+    BenchmarkKernels<RuntimeBoard>(szBoard, state, probes);
+    int nProbe = 0;
+    const Shield& shieldUnderTest = state.shields[0];
+    Benchmark("HitObstacle", szBoard, 1, [&]() {
+        const int k = nProbe++;
+        if (k % 1024 == 0) state.obstacles.place(shieldUnderTest); // keep cells to chip away
+        nBenchSink += state.obstacles.hit(shieldUnderTest.nX + k % (Shield::Length + 2) - 1,
+            shieldUnderTest.nY + (k / 7) % (Shield::Height + 2) - 1);
+    });
+    // and the kernels built for the board, if it has any
+    if (StandardBoard::configured()) {
+        strcat(szBoard, " fixed");
+        BenchmarkKernels<StandardBoard>(szBoard, state, probes);
+    }
+}
+
+
+// Run the micro-benchmarks on the standard board and on larger ones
+int RunBenchmarks()
+{
+    printf("kernels over arrays: %s\n", simd.szName);
+    printf("%-20s %-16s %12s %10s %12s %14s\n", "kernel", "board/aliens", "ns/op", "stddev", "min ns/op", "items/us");
+    BenchmarkBoard(120, 30, 10, 4, 5);
+    BenchmarkBoard(240, 60, 30, 10, 50);
+    BenchmarkBoard(400, 120, 60, 20, 200);
+    BenchmarkBoard(1000, 300, 160, 60, 256);
+    return 0;
+}
+
+
+struct Options {
+    int nTargetFps = 60;
+    int nWidth = 0, nHeight = 0;    // 0: as large as the console window
+    int nGridWidth = 10, nGridHeight = 4;
+    int nMaxAlienBullets = 5;
+    bool bHeadless = false;
+    bool bBench = false;
+    bool bSeed = false;     // true IFF a seed was given on the command line
+    uint32_t seed = 0;
+    int nGames = 1;
+    int nMaxSteps = 10*60*120;
+    int nThreads = 0;       // headless bot games in parallel; 0: as many as there are cores
+    string replayPath;
+    uint64_t nSeekStep = 0; // step of the recording to start the playback from
+    string recordPath;
+    int nKeyframeInterval = 60*120; // steps between keyframes in recordings; 0: none
+    string csvPath;     // per-frame timings
+    string tracePath;   // Chrome trace events
+    string simdName;    // instruction set of the kernels over arrays; empty: the widest the CPU supports
+    string telemetryAddress;        // host:port the game is sent to as it is played; empty: nowhere
+    int nTelemetryRate = 30;        // telemetry messages per second, at most
+    int nTelemetryBandwidth = 0;    // bytes of telemetry per second, at most; 0: unlimited
+    int nSpectatePort = 0;          // port to watch a game sent to; 0: play one
+};
+
+
+// Size the board after the recording, if any, else the command line, else the given default
+void ConfigureBoard(const Options& opt, const ReplayReader* pReplay, int nDefaultWidth, int nDefaultHeight)
+{
+    if (pReplay != NULL)
+        ConfigureBoard(pReplay->board[0], pReplay->board[1], pReplay->board[2], pReplay->board[3], pReplay->board[4]);
+    else if (opt.nWidth > 0)
+        ConfigureBoard(opt.nWidth, opt.nHeight, opt.nGridWidth, opt.nGridHeight, opt.nMaxAlienBullets);
+    else
+        ConfigureBoard(nDefaultWidth, nDefaultHeight, opt.nGridWidth, opt.nGridHeight, opt.nMaxAlienBullets);
+}
+
+
+// Start the playback from step nStep of the recording; true if the game is still on at that step
+bool SeekReplay(ReplayReader& replay, uint64_t nStep, GameState& state)
+{
+    if (! replay.seek(nStep, state))
+        throw runtime_error("the recording is only " + to_string(replay.nStep) + " steps long");
+    return ! state.bGameOver;
+}
+
+
+// Outcome of the games of a headless session
+struct HeadlessSummary {
+    int nGames;
+    long long nTotalSteps;
+    long long nTotalScore;
+    int nBestScore;
+    uint32_t hash;              // of the state at the end of each game, in the order of the games
+};
+
+
+/**
+ * Play the games of a headless session from `state`, carrying on with the game in it if
+ * bResume is set: the input comes from pReplay up to its end if given, or else from a `Bot`
+ * for opt.nGames games of at most opt.nMaxSteps steps. The steps go to pRecorder and
+ * pTelemetry, if given.
+ */
+HeadlessSummary PlayHeadless(const Options& opt, uint32_t seed, ReplayReader* pReplay, ReplayWriter* pRecorder,
+                             TelemetryPublisher* pTelemetry, GameState& state, bool bResume)
+{
+    HeadlessSummary summary = {0, 0, 0, 0, 0};
+    bool bEnd = false;
+    while (! bEnd && (pReplay || summary.nGames < opt.nGames)) {
+        NoAllocationScope noAllocation("a headless game");
+        if (! bResume) InitGame(state, seed, state.nGame + 1);
+        bResume = false;
+        Bot bot(seed, state.nGame);
+        int nSteps = 0;
+        bool bGivenUp = false;
+        while (! state.bGameOver) {
+            unsigned char nInput;
+            if (pReplay) {
+                if ((bGivenUp = pReplay->gameGivenUp())) break;
+                if (! pReplay->next(nInput)) { bEnd = true; break; }
+            }
+            else if ((bGivenUp = nSteps == opt.nMaxSteps)) break;
+            else nInput = bot.next();
+            if (pRecorder) pRecorder->write(state, nInput);
+            Step(state, nInput);
+            if (pTelemetry) pTelemetry->offer(state);
+            ++nSteps;
+        }
+        if (bGivenUp && pRecorder) pRecorder->giveUp();
+        if (nSteps == 0 && ! bGivenUp) break; // recording ended right after the last game
+        ++summary.nGames;
+        summary.nTotalSteps += nSteps;
+        summary.nTotalScore += state.nScore;
+        summary.nBestScore = max(summary.nBestScore, state.nScore);
+        summary.hash = summary.hash*31 + HashGameState(state);
+    }
+    return summary;
+}
+
+
+/**
+ * Play games without a console, as fast as possible, and print a summary of the outcome.
+ * Input comes from a recording if one is given; otherwise each game is played by a `Bot`.
+ * A recording made here is played back at the end, to check that it holds the same games.
+ */
+int RunHeadless(const Options& opt)
+{
+    unique_ptr<ReplayReader> pReplay;
+    uint32_t seed = opt.seed;
+    if (! opt.replayPath.empty()) {
+        pReplay.reset(new ReplayReader(opt.replayPath));
+        seed = pReplay->seed;
+    }
+    ConfigureBoard(opt, pReplay.get(), 120, 30);
+    GameState state;
+    state.nGame = -1; // the first game started is game 0
+    // true: carry on with the game restored from the recording, rather than start a new one
+    const bool bResume = pReplay && SeekReplay(*pReplay, opt.nSeekStep, state);
+    // recording a playback: the recording starts where the playback does, in any game
+    unique_ptr<ReplayWriter> pRecorder;
+    if (! opt.recordPath.empty()) pRecorder.reset(new ReplayWriter(opt.recordPath, seed, opt.nKeyframeInterval, pReplay != NULL));
+    unique_ptr<TelemetryPublisher> pTelemetry;
+    if (! opt.telemetryAddress.empty())
+        pTelemetry.reset(new TelemetryPublisher(opt.telemetryAddress, opt.nTelemetryRate, opt.nTelemetryBandwidth));
+
+    auto tpStart = chrono::steady_clock::now();
+    const HeadlessSummary summary = PlayHeadless(opt, seed, pReplay.get(), pRecorder.get(), pTelemetry.get(), state, bResume);
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - tpStart;
+
+    cout << "seed: " << seed << endl
+         << "games: " << summary.nGames << endl
+         << "steps: " << summary.nTotalSteps << " (" << summary.nTotalSteps*fTimeStep << " s of play)" << endl
+         << "score: total " << summary.nTotalScore << ", best " << summary.nBestScore << endl
+         << "state hash: " << hex << summary.hash << dec << endl
+         << "steps per second: " << (elapsed.count() > 0 ? summary.nTotalSteps / elapsed.count(): 0.0) << endl;
+    if (pTelemetry) {
+        pTelemetry->stop();
+        cout << "telemetry: " << pTelemetry->nSent << " messages, " << pTelemetry->nBytes << " bytes, "
+             << pTelemetry->dropped() << " states dropped" << endl;
+    }
+    if (pRecorder) {
+        pRecorder.reset(); // closes the recording
+        ReplayReader recording(opt.recordPath);
+        GameState playback;
+        playback.nGame = -1;
+        const bool bPlaybackResume = SeekReplay(recording, 0, playback);
+        const HeadlessSummary played = PlayHeadless(opt, seed, &recording, NULL, NULL, playback, bPlaybackResume);
+        if (played.hash != summary.hash || played.nGames != summary.nGames)
+            throw runtime_error("the recording " + opt.recordPath + " does not play back the games played");
+        cout << "recording: plays back the same " << played.nGames << (played.nGames == 1 ? " game": " games") << endl;
+    }
+    return 0;
+}
+
+
+/**
+ * Runs the tasks 0 to nTasks - 1 on nThreads threads. Each thread is dealt a contiguous
+ * share of the tasks, which it takes from the front; once done with its own, it steals from
+ * the back of the share of another thread, so that threads stay busy until the very end
+ * even though games differ a lot in length.
+ */
+struct WorkStealingPool {
+    struct Share {
+        mutex m_mutex;
+        int nFront;     // the tasks left are [nFront, nBack)
+        int nBack;
+    };
+
+
+    template <typename TaskFn>
+    static void run(int nTasks, int nThreads, TaskFn task) {
+        vector<Share> shares(nThreads);
+        for (int k = 0; k < nThreads; ++k) {
+            shares[k].nFront = (int)((long long)nTasks*k / nThreads);
+            shares[k].nBack = (int)((long long)nTasks*(k + 1) / nThreads);
+        }
+        vector<thread> threads;
+        for (int k = 0; k < nThreads; ++k)
+            threads.emplace_back([&shares, &task, k, nThreads]() {
+                int nTask;
+                while (take(shares[k], true, &nTask)) task(nTask);
+                for (int nVictim = (k + 1) % nThreads; nVictim != k; nVictim = (nVictim + 1) % nThreads)
+                    while (take(shares[nVictim], false, &nTask)) task(nTask);
+            });
+        for (auto& worker: threads) worker.join();
+    }
+
+
+    // The first task of a share for its owner, the last one for a thief; false if there is none
+    static bool take(Share& share, bool bOwner, int* pTask) {
+        lock_guard<mutex> lock(share.m_mutex);
+        if (share.nFront == share.nBack) return false;
+        *pTask = bOwner ? share.nFront++: --share.nBack;
+        return true;
+    }
+};
+
+
+/**
+ * Let the bot play opt.nGames games spread over opt.nThreads threads (all cores by default),
+ * each game from a seed of its own, and print statistics over all of them. Games are seeded
+ * after their number rather than after the thread that plays them, so the results do not
+ * depend on the number of threads.
+ */
+int RunBatch(const Options& opt)
+{
+    ConfigureBoard(opt, NULL, 120, 30);
+    const int nThreads = max(1, min(opt.nThreads > 0 ? opt.nThreads: (int)thread::hardware_concurrency(), max(opt.nGames, 1)));
+    struct GameResult {
+        int nSteps;
+        int nScore;
+        int nLives;
+        uint32_t hash;
+    };
+    vector<GameResult> results(max(opt.nGames, 0));
+
+    auto tpStart = chrono::steady_clock::now();
+    WorkStealingPool::run((int)results.size(), nThreads, [&](int nGame) {
+        GameState state;
+        Bot bot(opt.seed, nGame);
+        NoAllocationScope noAllocation("a bot game");
+        InitGame(state, opt.seed, nGame);
+        int nSteps = 0;
+        for (; ! state.bGameOver && nSteps < opt.nMaxSteps; ++nSteps) Step(state, bot.next());
+        results[nGame] = {nSteps, state.nScore, state.nLives, HashGameState(state)};
+    });
+    chrono::duration<double> elapsed = chrono::steady_clock::now() - tpStart;
+
+    long long nTotalSteps = 0, nTotalScore = 0, nTotalLives = 0;
+    int nBestScore = 0, nWorstScore = INT_MAX, nGamesWon = 0;
+    uint32_t hash = 0;
+    for (const GameResult& result: results) {
+        nTotalSteps += result.nSteps;
+        nTotalScore += result.nScore;
+        nTotalLives += result.nLives;
+        nBestScore = max(nBestScore, result.nScore);
+        nWorstScore = min(nWorstScore, result.nScore);
+        // the bot ran out of steps before running out of lives
+        nGamesWon += result.nLives > 0;
+        hash = hash*31 + result.hash;
+    }
+    const double fGames = max((double)results.size(), 1.0);
+    cout << "seed: " << opt.seed << endl
+         << "games: " << results.size() << " on " << nThreads << (nThreads == 1 ? " thread": " threads") << endl
+         << "steps: " << nTotalSteps << " (" << nTotalSteps*fTimeStep << " s of play), " << nTotalSteps / fGames << " per game" << endl
+         << "score: total " << nTotalScore << ", best " << nBestScore << ", worst " << (results.empty() ? 0: nWorstScore)
+         << ", mean " << nTotalScore / fGames << endl
+         << "lives left: mean " << nTotalLives / fGames << ", games survived " << nGamesWon << endl
+         << "state hash: " << hex << hash << dec << endl
+         << "steps per second: " << (elapsed.count() > 0 ? nTotalSteps / elapsed.count(): 0.0) << endl;
+    return 0;
+}
+
+
+int RunConsole(const Options& opt)
+{
+    unique_ptr<ReplayReader> pReplay;
+    uint32_t seed = opt.bSeed ? opt.seed: (uint32_t)chrono::steady_clock::now().time_since_epoch().count();
+    if (! opt.replayPath.empty()) {
+        pReplay.reset(new ReplayReader(opt.replayPath));
+        seed = pReplay->seed;
+    }
+    // fill the console window, unless told otherwise
+    unique_ptr<TerminalBackend> pTerminal = CreateTerminal();
+    int nWindowWidth, nWindowHeight;
+    if (pTerminal->windowSize(&nWindowWidth, &nWindowHeight))
+        ConfigureBoard(opt, pReplay.get(), nWindowWidth, nWindowHeight);
+    else
+        ConfigureBoard(opt, pReplay.get(), 120, 30);
+    GameState state;
+    state.nGame = -1; // the first game started is game 0
+    bool bResume = pReplay && SeekReplay(*pReplay, opt.nSeekStep, state);
+    // recording a playback: the recording starts where the playback does, in any game
+    unique_ptr<ReplayWriter> pRecorder;
+    if (! opt.recordPath.empty()) pRecorder.reset(new ReplayWriter(opt.recordPath, seed, opt.nKeyframeInterval, pReplay != NULL));
+    unique_ptr<TelemetryPublisher> pTelemetry;
+    if (! opt.telemetryAddress.empty())
+        pTelemetry.reset(new TelemetryPublisher(opt.telemetryAddress, opt.nTelemetryRate, opt.nTelemetryBandwidth));
+    if (! opt.csvPath.empty()) profiler.openCsv(opt.csvPath);
+    if (! opt.tracePath.empty()) profiler.openTrace(opt.tracePath);
+
+    ClearBuffer(screen);
+    TerminalBackend& terminal = *pTerminal;
+    terminal.open();
+    InputThread inputThread(terminal);
+    KeyboardState keyboard;
+    PresentThread presentThread(terminal);
+    FrameScheduler scheduler(opt.nTargetFps);
+    profiler.enable();
+    // the statistics of the frames change on every frame, they are shown 4 times a second
+    Hud hud;
+    const int nScoreField = hud.add("Score", 6);
+    const int nLivesField = hud.add("Lives", 2);
+    const int nFpsField = hud.add("FPS", 7, 1, 0.25f);
+    const int nCellsField = hud.add("Cells", 5, 0, 0.25f);
+    bool bShowOverlay = false;
+    bool bPaused = false;
+    bool bQuit = false;
+    while (! bQuit) {
+        NoAllocationScope noAllocation("the frame loop");
+        if (! bResume) InitGame(state, seed, state.nGame + 1);
+        bResume = false;
+        // initialize timers; the steady clock is monotonic, so time never runs backwards
+        auto tp1 = chrono::steady_clock::now();
+        auto tp2 = chrono::steady_clock::now();
+        float fAccumulator = 0.0f;
+        while (! state.bGameOver) {
+            // Update timing
+            tp2 = chrono::steady_clock::now();
+            chrono::duration<float> elapsedTime = tp2 - tp1;
+            tp1 = tp2;
+            // a frame stalled by the debugger or a suspended console must not become a giant leap
+            const float fFrameTime = min(max(elapsedTime.count(), 0.0f), fMaxFrameLag);
+            frameStats.add(fFrameTime);
+            hud.advance(fFrameTime);
+            // drop the time we cannot catch up with, rather than stalling on a burst of updates
+            fAccumulator = min(fAccumulator + fFrameTime, fMaxFrameLag);
+
+            // Advance the simulation in fixed steps, independently of the frame rate
+            {
+                ProfileScope scope(PHASE_UPDATE);
+                // while paused, the keys are still read once per frame, for P to resume
+                while ((bPaused || fAccumulator >= fTimeStep) && ! state.bGameOver) {
+                    // Get Player Input: whatever the input thread has seen since the last step
+                    unsigned char nStepInput;
+                    {
+                        ProfileScope scope(PHASE_INPUT);
+                        nStepInput = keyboard.drain(inputThread.queue);
+                    }
+                    // F3 toggles the profiling overlay
+                    if (keyboard.bOverlayPressed) bShowOverlay = ! bShowOverlay;
+                    if (nStepInput & (1 << ESC)) { // player requests exit
+                        state.bGameOver = bQuit = true;
+                        break;
+                    }
+                    // P pauses the game and resumes it: the steps stop, the frames go on
+                    if (keyboard.nPressed & (1 << PAUSE)) bPaused = ! bPaused;
+                    if (bPaused) {
+                        fAccumulator = 0.0f;
+                        break;
+                    }
+                    if (fAccumulator < fTimeStep) break; // just resumed
+                    fAccumulator -= fTimeStep;
+                    if (pReplay && pReplay->gameGivenUp()) {
+                        if (pRecorder) pRecorder->giveUp();
+                        state.bGameOver = true;
+                        break;
+                    }
+                    if (pReplay && ! pReplay->next(nStepInput)) {
+                        state.bGameOver = bQuit = true;
+                        break;
+                    }
+                    if (pRecorder) pRecorder->write(state, nStepInput);
+                    Step(state, nStepInput);
+                }
+            }
+            if (pTelemetry) pTelemetry->offer(state);
+
+            // Update screen
+            {
+                ProfileScope scope(PHASE_DRAW);
+                DrawGame(state);
+                hud.set(nScoreField, state.nScore);
+                hud.set(nLivesField, state.nLives);
+                // the first frame is over as soon as it starts: one sample is no estimate
+                if (frameStats.m_nCount > 1) hud.set(nFpsField, frameStats.fps());
+                hud.set(nCellsField, presentThread.nCellsWritten.load());
+                hud.draw(2, 0);
+                if (bPaused) DrawString(nScreenWidth/2 - 3, nScreenHeight/2, "PAUSED", COLOUR_HUD);
+                if (bShowOverlay) DrawProfileOverlay();
+            }
+            // Show it: the present thread takes it from here
+            presentThread.submit(screen);
+            chrono::steady_clock::time_point presentStart, presentEnd;
+            if (presentThread.lastPresent(&presentStart, &presentEnd))
+                profiler.record(PHASE_PRESENT, presentStart, presentEnd);
+            scheduler.wait();
+            profiler.endFrame();
+        }
+        DrawString(nScreenWidth/2 - 20, nScreenHeight/2, "GAME OVER! Press Spacebar to restart.", COLOUR_HUD);
+        presentThread.submit(screen);
+        // a replay goes on with its next game right away
+        if (pReplay) continue;
+        // Spacebar: continue, ESC: exit; sleep until a key is pressed
+        while (! bQuit) {
+            inputThread.queue.wait();
+            keyboard.drain(inputThread.queue);
+            if (keyboard.nPressed & (1 << SPACEBAR)) break;
+            bQuit = (keyboard.nPressed & (1 << ESC)) != 0;
+        }
+    }
+
+    inputThread.stop();
+    presentThread.stop();
+    terminal.close();
+	cout << "Game Over!!" << endl;
+    return 0;
+}
+
+
+// Watch the game sent by a TelemetryPublisher to port opt.nSpectatePort, until Esc is pressed
+int RunSpectator(const Options& opt)
+{
+    UdpSocket socket;
+    socket.bind(opt.nSpectatePort);
+    vector<unsigned char> message(MaxTelemetryBytes);
+    // the board is that of the first keyframe
+    cerr << "Waiting for a game on port " << opt.nSpectatePort << "..." << endl;
+    int16_t board[4];
+    int nBytes;
+    do {
+        socket.wait(-1);
+        nBytes = socket.receive(message.data(), message.size());
+    } while (nBytes < 0 || ! TelemetryReader::keyframe(message.data(), nBytes, board));
+    ConfigureBoard(board[0], board[1], board[2], board[3], BulletPool::MaxCapacity);
+    unique_ptr<TelemetryReader> pReader(new TelemetryReader());
+    TelemetryReader& reader = *pReader;
+    reader.apply(message.data(), nBytes);
+
+    unique_ptr<TerminalBackend> pTerminal = CreateTerminal();
+    TerminalBackend& terminal = *pTerminal;
+    terminal.open();
+    InputThread inputThread(terminal);
+    KeyboardState keyboard;
+    PresentThread presentThread(terminal);
+    Hud hud;
+    const int nScoreField = hud.add("Score", 6);
+    const int nLivesField = hud.add("Lives", 2);
+    const int nIgnoredField = hud.add("Lost", 6);
+    bool bChanged = true;
+    while (true) {
+        NoAllocationScope noAllocation("the spectator loop");
+        if (keyboard.drain(inputThread.queue) & (1 << ESC)) break;
+        if (bChanged) {
+            DrawGame(reader.state);
+            hud.set(nScoreField, reader.state.nScore);
+            hud.set(nLivesField, reader.state.nLives);
+            hud.set(nIgnoredField, (int)reader.nIgnored);
+            hud.draw(2, 0);
+            if (reader.state.bGameOver) DrawString(nScreenWidth/2 - 5, nScreenHeight/2, "GAME OVER!", COLOUR_HUD);
+            presentThread.submit(screen);
+        }
+        // a short wait, for the keyboard
+        bChanged = false;
+        if (socket.wait(50))
+            while ((nBytes = socket.receive(message.data(), message.size())) >= 0)
+                bChanged = reader.apply(message.data(), nBytes) || bChanged;
+    }
+
+    inputThread.stop();
+    presentThread.stop();
+    terminal.close();
+    return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+    Options opt;
+    for (int k = 1; k < argc; ++k) {
+        const string arg = argv[k];
+        const bool bHasValue = k + 1 < argc;
+        if (arg == "--fps" && bHasValue) opt.nTargetFps = atoi(argv[++k]);
+        else if (arg == "--size" && bHasValue && sscanf(argv[k+1], "%dx%d", &opt.nWidth, &opt.nHeight) == 2) ++k;
+        else if (arg == "--max-bullets" && bHasValue) opt.nMaxAlienBullets = atoi(argv[++k]);
+        else if (arg == "--aliens" && bHasValue && sscanf(argv[k+1], "%dx%d", &opt.nGridWidth, &opt.nGridHeight) == 2) ++k;
+        else if (arg == "--headless") opt.bHeadless = true;
+        else if (arg == "--bench") opt.bBench = true;
+        else if (arg == "--seed" && bHasValue) { opt.seed = (uint32_t)strtoul(argv[++k], NULL, 0); opt.bSeed = true; }
+        else if (arg == "--games" && bHasValue) opt.nGames = atoi(argv[++k]);
+        else if (arg == "--max-steps" && bHasValue) opt.nMaxSteps = atoi(argv[++k]);
+        else if (arg == "--threads" && bHasValue) opt.nThreads = atoi(argv[++k]);
+        else if (arg == "--replay" && bHasValue) opt.replayPath = argv[++k];
+        else if (arg == "--seek" && bHasValue) opt.nSeekStep = strtoull(argv[++k], NULL, 0);
+        else if (arg == "--record" && bHasValue) opt.recordPath = argv[++k];
+        else if (arg == "--keyframes" && bHasValue) opt.nKeyframeInterval = atoi(argv[++k]);
+        else if (arg == "--trace-csv" && bHasValue) opt.csvPath = argv[++k];
+        else if (arg == "--trace-json" && bHasValue) opt.tracePath = argv[++k];
+        else if (arg == "--simd" && bHasValue) opt.simdName = argv[++k];
+        else if (arg == "--telemetry" && bHasValue) opt.telemetryAddress = argv[++k];
+        else if (arg == "--telemetry-rate" && bHasValue) opt.nTelemetryRate = atoi(argv[++k]);
+        else if (arg == "--telemetry-bandwidth" && bHasValue) opt.nTelemetryBandwidth = atoi(argv[++k]);
+        else if (arg == "--spectate" && bHasValue) opt.nSpectatePort = atoi(argv[++k]);
+        else {
+            cerr << "Usage: " << argv[0] << " [options]" << endl
+                 << "  --fps N         frames drawn per second (default 60, 0: unlimited)" << endl
+                 << "  --size WxH      size of the board (default: the console window, 120x30 headless)" << endl
+                 << "  --aliens WxH    columns and rows of aliens (default 10x4)" << endl
+                 << "  --max-bullets N alien bullets in flight at the same time (default 5)" << endl
+                 << "  --seed N        seed of the random number generator" << endl
+                 << "  --record FILE   record the session to FILE" << endl
+                 << "  --keyframes N   steps between the snapshots of the game in recordings (default 7200, 0: none)" << endl
+                 << "  --replay FILE   play back the session recorded in FILE" << endl
+                 << "  --seek N        start the playback from step N of the recording" << endl
+                 << "  --headless      run without a console, as fast as possible" << endl
+                 << "  --games N       headless games played by the bot, without --replay (default 1)" << endl
+                 << "  --max-steps N   longest headless game played by the bot (default 72000)" << endl
+                 << "  --threads N     threads playing the headless games, without --replay and --record (default: all cores)" << endl
+                 << "  --bench         time the kernels run on every frame and exit" << endl
+                 << "  --simd NAME     instruction set of the kernels: scalar, sse2 or avx2 (default: the best supported)" << endl
+                 << "  --telemetry HOST:PORT  send the game to HOST:PORT over UDP as it is played" << endl
+                 << "  --telemetry-rate N     telemetry messages per second, at most (default 30)" << endl
+                 << "  --telemetry-bandwidth N  bytes of telemetry per second, at most (default: unlimited)" << endl
+                 << "  --spectate PORT        watch the game sent to PORT with --telemetry" << endl
+                 << "  --trace-csv F   write the time spent in each phase of every frame to F" << endl
+                 << "  --trace-json F  write the phases of every frame to F, in Chrome trace format" << endl
+                 << "Press F3 while playing to show the time spent in each phase of the frame." << endl;
+            return 1;
+        }
+    }
+    if (opt.nTargetFps < 0) {
+        cerr << "Invalid frame rate: " << opt.nTargetFps << endl;
+        return 1;
+    }
+    if (opt.nKeyframeInterval < 0) {
+        cerr << "Invalid keyframe interval: " << opt.nKeyframeInterval << endl;
+        return 1;
+    }
+    if (opt.nTelemetryRate < 1 || opt.nTelemetryBandwidth < 0) {
+        cerr << "Invalid telemetry rate or bandwidth" << endl;
+        return 1;
+    }
+    if (opt.nSpectatePort < 0 || opt.nSpectatePort > 65535) {
+        cerr << "Invalid port: " << opt.nSpectatePort << endl;
+        return 1;
+    }
+    if ( ! opt.simdName.empty()) {
+        const SimdKernels* pKernels = FindSimdKernels(opt.simdName.c_str());
+        if (pKernels == NULL) {
+            cerr << "Instruction set not supported: " << opt.simdName << endl;
+            return 1;
+        }
+        simd = *pKernels;
+    }
+
+    try {
+        if (opt.bBench) return RunBenchmarks();
+        if (opt.nSpectatePort > 0) return RunSpectator(opt);
+        // bot games that are not recorded nor watched are independent of each other, and can be played in parallel
+        if (opt.bHeadless && opt.replayPath.empty() && opt.recordPath.empty() && opt.telemetryAddress.empty())
+            return RunBatch(opt);
+        return opt.bHeadless ? RunHeadless(opt): RunConsole(opt);
+    }
+    catch (const exception& e) {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+}